@@ -0,0 +1,531 @@
+// Hooking.Patterns - benchmark
+// Host Linux only: scans deterministic synthetic images (random, x86-like, ARM64-like, the x86 one again
+// from a file evicted from the page cache before every run)
+// and reports GB/s, the scanner's candidates per MB and latency percentiles per scanning engine,
+// plus the cost of metadata discovery (ELF sections, function index) on the loaded modules.
+// Every match count is checked against a byte by byte search of the image, the exit code is 1 on a difference.
+//
+// usage: HookingPatternsBenchmark [--size MB] [--runs N] [--seed N] [--quick]
+
+#include "../include/Hooking.Patterns.h"
+
+#include <fcntl.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+// the candidates column is the scanner's own count, CMake builds the benchmark against a copy of the library with the statistics on
+#if !PATTERNS_USE_STATS
+#error the benchmark needs PATTERNS_USE_STATS
+#endif
+
+namespace
+{
+
+// xorshift64*, the images must be the same on every run
+struct random_bytes
+{
+	uint64_t state;
+
+	explicit random_bytes(uint64_t seed) : state(seed ? seed : 0x9E3779B97F4A7C15ull) {}
+
+	uint64_t next()
+	{
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		return state * 0x2545F4914F6CDD1Dull;
+	}
+
+	uint32_t below(uint32_t bound) { return static_cast<uint32_t>(next() % bound); }
+	uint8_t byte() { return static_cast<uint8_t>(next() >> 56); }
+};
+
+struct corpus
+{
+	const char* name;
+	uint8_t* data;
+	size_t size;
+};
+
+struct signature
+{
+	const char* name;
+	const char* pattern;
+};
+
+struct engine
+{
+	const char* name;
+	std::function<void(hook::pattern&)> apply;
+	size_t align; // the candidates the engine accepts, for the expected count
+};
+
+// results which differ from the byte by byte search
+int failures = 0;
+
+#if PATTERNS_USE_HINTS
+const bool hintCache = true;
+#else
+const bool hintCache = false;
+#endif
+
+void FillRandom(uint8_t* data, size_t size, random_bytes& random)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		data[i] = random.byte();
+	}
+}
+
+// instruction shaped x86-64: prologues, rip relative loads, calls, jcc, int3 padding
+void FillX86(uint8_t* data, size_t size, random_bytes& random)
+{
+	static const uint8_t common[] = { 0x00, 0x48, 0x89, 0x8B, 0x0F, 0x83, 0x85, 0xC0, 0x24, 0x44, 0x4C, 0xFF, 0xE8, 0x74, 0x75, 0x41 };
+
+	size_t i = 0;
+	auto put = [&](std::initializer_list<uint8_t> bytes)
+	{
+		for (uint8_t value : bytes)
+		{
+			if (i < size) data[i++] = value;
+		}
+	};
+	auto rel32 = [&]()
+	{
+		uint32_t value = random.below(0x100000) - 0x80000;
+		put({ uint8_t(value), uint8_t(value >> 8), uint8_t(value >> 16), uint8_t(value >> 24) });
+	};
+
+	while (i < size)
+	{
+		switch (random.below(12))
+		{
+		case 0: put({ 0x55, 0x48, 0x89, 0xE5 }); break;
+		case 1: put({ 0x48, 0x8B, 0x05 }); rel32(); break;
+		case 2: put({ 0xE8 }); rel32(); break;
+		case 3: put({ 0x48, 0x85, 0xC0, 0x74, random.byte() }); break;
+		case 4: put({ 0x48, 0x89, uint8_t(0x40 | random.below(64)), random.byte() }); break;
+		case 5: put({ 0x5D, 0xC3 }); while (i % 16) put({ 0xCC }); break;
+		case 6: put({ 0x0F, 0x84 }); rel32(); break;
+		case 7: put({ 0x41, uint8_t(0x54 + random.below(4)) }); break;
+		default: put({ common[random.below(sizeof(common))], random.byte() }); break;
+		}
+	}
+}
+
+// instruction shaped AArch64: little endian words, BL/ADRP/LDR/STP/RET/NOP mix
+void FillArm64(uint8_t* data, size_t size, random_bytes& random)
+{
+	for (size_t i = 0; i + 4 <= size; i += 4)
+	{
+		uint32_t word;
+		switch (random.below(10))
+		{
+		case 0: word = 0x94000000 | random.below(1 << 26); break;                             // bl
+		case 1: word = 0x90000000 | (random.below(4) << 29) | (random.below(1 << 19) << 5) | random.below(29); break; // adrp
+		case 2: word = 0xF9400000 | (random.below(1 << 12) << 10) | (random.below(31) << 5) | random.below(31); break; // ldr
+		case 3: word = 0xA9BF7BFD; break;                                                     // stp x29, x30, [sp, #-16]!
+		case 4: word = 0x910003FD; break;                                                     // mov x29, sp
+		case 5: word = 0xD65F03C0; break;                                                     // ret
+		case 6: word = 0xD503201F; break;                                                     // nop
+		case 7: word = 0xAA0003E0 | (random.below(31) << 16) | random.below(31); break;       // mov
+		default: word = 0x91000000 | (random.below(1 << 12) << 10) | (random.below(31) << 5) | random.below(31); break; // add
+		}
+		memcpy(data + i, &word, sizeof(word));
+	}
+}
+
+// "48 8B ? 94&FC" -> bytes and mask, the subset of the pattern syntax the signatures here use
+void ParsePattern(const char* pattern, std::vector<uint8_t>& bytes, std::vector<uint8_t>& mask)
+{
+	for (const char* p = pattern; *p;)
+	{
+		if (*p == ' ')
+		{
+			p++;
+		}
+		else if (*p == '?')
+		{
+			bytes.push_back(0);
+			mask.push_back(0);
+			p++;
+		}
+		else
+		{
+			uint8_t value = static_cast<uint8_t>(strtoul(std::string(p, 2).c_str(), nullptr, 16));
+			uint8_t bits = 0xFF;
+			p += 2;
+			if (*p == '&')
+			{
+				bits = static_cast<uint8_t>(strtoul(std::string(p + 1, 2).c_str(), nullptr, 16));
+				p += 3;
+			}
+			bytes.push_back(value & bits);
+			mask.push_back(bits);
+		}
+	}
+}
+
+// write a concrete instance of the signature, wildcard bits are random
+void Plant(uint8_t* data, const char* pattern, random_bytes& random)
+{
+	std::vector<uint8_t> bytes, mask;
+	ParsePattern(pattern, bytes, mask);
+	for (size_t i = 0; i < bytes.size(); i++)
+	{
+		data[i] = bytes[i] | (random.byte() & ~mask[i]);
+	}
+}
+
+// byte by byte search, the expected match count
+size_t CountMatches(const corpus& image, const char* pattern, size_t align)
+{
+	std::vector<uint8_t> bytes, mask;
+	ParsePattern(pattern, bytes, mask);
+
+	size_t count = 0;
+	for (size_t i = 0; i + bytes.size() <= image.size; i += align)
+	{
+		size_t j = 0;
+		while (j < bytes.size() && (image.data[i + j] & mask[j]) == bytes[j]) j++;
+		count += (j == bytes.size());
+	}
+	return count;
+}
+
+struct latency
+{
+	std::vector<double> samples; // microseconds
+
+	double percentile(double p)
+	{
+		if (samples.empty())
+		{
+			return 0.0;
+		}
+		std::sort(samples.begin(), samples.end());
+		return samples[std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()))];
+	}
+};
+
+template<typename Function>
+double Measure(Function&& function)
+{
+	auto start = std::chrono::steady_clock::now();
+	function();
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+void PrintHeader(const char* title)
+{
+	printf("\n%s\n", title);
+	printf("%-8s %-16s %-12s %9s %10s %10s %10s %10s %8s %8s\n", "corpus", "signature", "engine", "GB/s", "cand/MB", "p50(us)", "p90(us)", "p99(us)", "matches", "expected");
+}
+
+// evict: called before every run, outside the measurement
+void RunScans(const corpus& image, const std::vector<signature>& signatures, const std::vector<engine>& engines, int runs, const std::function<void()>& evict = {})
+{
+	for (auto& sig : signatures)
+	{
+		for (auto& eng : engines)
+		{
+			latency times;
+			size_t matches = 0;
+			double candidates = 0;
+			for (int run = 0; run < runs; run++)
+			{
+				if (evict)
+				{
+					evict();
+				}
+				times.samples.push_back(Measure([&]
+				{
+					auto pattern = hook::make_range_pattern(reinterpret_cast<uintptr_t>(image.data), reinterpret_cast<uintptr_t>(image.data) + image.size, sig.pattern);
+					eng.apply(pattern);
+					matches = pattern.size();
+					candidates = pattern.stats().candidates / (image.size / 1048576.0);
+				}));
+			}
+
+			const size_t expected = CountMatches(image, sig.pattern, eng.align);
+			const double p50 = times.percentile(0.50);
+			printf("%-8s %-16s %-12s %9.2f %10.1f %10.1f %10.1f %10.1f %8zu %8zu%s\n", image.name, sig.name, eng.name,
+				p50 > 0 ? image.size / (p50 * 1e3) : 0.0, candidates, p50, times.percentile(0.90), times.percentile(0.99), matches, expected,
+				matches == expected ? "" : "  MISMATCH");
+			failures += (matches != expected);
+		}
+	}
+}
+
+// count_hint(1) on a single planted signature, the scan stops at the match
+void RunFirstMatch(const corpus& image, const char* pattern, const uint8_t* planted, int runs)
+{
+	latency times;
+	size_t matches = 0;
+	bool found = false;
+	for (int run = 0; run < runs; run++)
+	{
+		times.samples.push_back(Measure([&]
+		{
+			auto result = hook::make_range_pattern(reinterpret_cast<uintptr_t>(image.data), reinterpret_cast<uintptr_t>(image.data) + image.size, pattern).count_hint(1);
+			matches = result.size();
+			found = matches != 0 && result.get(0).get<uint8_t>() == planted;
+		}));
+	}
+
+	const size_t expected = CountMatches(image, pattern, 1);
+	const bool ok = matches == expected && found;
+	printf("%-8s %-16s %-12s %9s %10s %10.1f %10.1f %10.1f %8zu %8zu%s\n", image.name, "unique@3/4", "count_hint1", "-", "-",
+		times.percentile(0.50), times.percentile(0.90), times.percentile(0.99), matches, expected, ok ? "" : "  MISMATCH");
+	failures += !ok;
+}
+
+// image as a private file mapping, dropped from the page cache before every run so the scans start on cold pages
+bool RunColdFile(const corpus& image, const std::vector<signature>& signatures, const std::vector<engine>& engines, int runs)
+{
+	char path[] = "HookingPatternsBenchmark.XXXXXX";
+	int fd = mkstemp(path);
+	if (fd == -1)
+	{
+		perror("mkstemp");
+		return false;
+	}
+	unlink(path);
+
+	size_t written = 0;
+	while (written < image.size)
+	{
+		ssize_t result = write(fd, image.data + written, image.size - written);
+		if (result <= 0)
+		{
+			break;
+		}
+		written += result;
+	}
+
+	void* memory = (written == image.size && fsync(fd) == 0) ? mmap(nullptr, image.size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	if (memory == MAP_FAILED)
+	{
+		perror("file image");
+		close(fd);
+		return false;
+	}
+
+	// without read-around a fault reads its own page only, the first touch of the mapping would otherwise bring
+	// back the whole image (the readahead of a block device can be larger than it)
+	madvise(memory, image.size, MADV_RANDOM);
+
+	// the pages have to be unmapped before the page cache lets go of them
+	corpus file = { "file", static_cast<uint8_t*>(memory), image.size };
+	RunScans(file, signatures, engines, runs, [&]()
+	{
+		madvise(memory, image.size, MADV_DONTNEED);
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	});
+
+	munmap(memory, image.size);
+	close(fd);
+	return true;
+}
+
+std::vector<std::string> LoadedModules()
+{
+	std::vector<std::string> modules;
+	dl_iterate_phdr([](struct dl_phdr_info* info, size_t, void* data) -> int
+	{
+		if (info->dlpi_name != nullptr && info->dlpi_name[0] == '/')
+		{
+			reinterpret_cast<std::vector<std::string>*>(data)->emplace_back(info->dlpi_name);
+		}
+		return 0;
+	}, &modules);
+	return modules;
+}
+
+// executable_meta parses the section headers on every pattern, the function index is built once per module
+void RunMetadata(int runs)
+{
+	printf("\nmetadata discovery\n");
+	printf("%-48s %-14s %10s %10s %10s\n", "module", "kind", "p50(us)", "p90(us)", "p99(us)");
+
+	for (auto& module : LoadedModules())
+	{
+		latency sections;
+		for (int run = 0; run < runs; run++)
+		{
+			sections.samples.push_back(Measure([&]
+			{
+				hook::make_section_pattern(module, ".note.gnu.build-id", "DE AD BE EF DE AD BE EF DE AD BE EF").size();
+			}));
+		}
+
+		latency functions;
+		for (int run = 0; run < runs; run++)
+		{
+			functions.samples.push_back(Measure([&]
+			{
+				hook::make_section_pattern(module, ".text", "DE AD BE EF DE AD BE EF").function_start().size();
+			}));
+		}
+		const double cold = functions.samples.front();
+
+		std::string name = module.size() > 48 ? "..." + module.substr(module.size() - 45) : module;
+		printf("%-48s %-14s %10.1f %10.1f %10.1f\n", name.c_str(), "sections", sections.percentile(0.50), sections.percentile(0.90), sections.percentile(0.99));
+		printf("%-48s %-14s %10.1f %10s %10s\n", "", "functions/cold", cold, "-", "-");
+		printf("%-48s %-14s %10.1f %10.1f %10.1f\n", "", "functions/warm", functions.percentile(0.50), functions.percentile(0.90), functions.percentile(0.99));
+	}
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	size_t sizeMB = 64;
+	int runs = 10;
+	uint64_t seed = 1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--quick") == 0)
+		{
+			sizeMB = 4;
+			runs = 3;
+		}
+		else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+		{
+			sizeMB = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+		}
+		else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+		{
+			runs = std::max(1, atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+		{
+			seed = strtoull(argv[++i], nullptr, 10);
+		}
+		else
+		{
+			printf("usage: %s [--size MB] [--runs N] [--seed N] [--quick]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	const size_t size = sizeMB << 20;
+	printf("Hooking.Patterns benchmark: %zu MB per image, %d runs, seed %llu\n", sizeMB, runs, static_cast<unsigned long long>(seed));
+
+	const std::vector<signature> x86Signatures =
+	{
+		{ "mov-rip-test", "48 8B 05 ? ? ? ? 48 85 C0 74 ?" },
+		{ "prologue", "55 48 89 E5 41 57 41 56" },
+		{ "call-test", "E8 ? ? ? ? 84 C0 75 ?" },
+	};
+
+	const std::vector<signature> arm64Signatures =
+	{
+		{ "prologue", "FD 7B BF A9 FD 03 00 91" },
+		{ "bl-adrp", "? ? ? 94&FC ? ? ? 90&9F" },
+		{ "ldr-ret", "? ? 40&C0 F9 C0 03 5F D6" },
+	};
+
+	const std::vector<engine> engines =
+	{
+		{ "plain", [](hook::pattern&) {}, 1 },
+		{ "safe_read", [](hook::pattern& pattern) { pattern.safe_read(); }, 1 },
+		{ "prefetch", [](hook::pattern& pattern) { pattern.prefetch(); }, 1 },
+	};
+
+	const std::vector<engine> fileEngines =
+	{
+		{ "plain", [](hook::pattern&) {}, 1 },
+		{ "prefetch", [](hook::pattern& pattern) { pattern.prefetch(); }, 1 },
+	};
+
+	std::vector<engine> arm64Engines = engines;
+	arm64Engines.push_back({ "aligned4", [](hook::pattern& pattern) { pattern.aligned(4); }, 4 });
+
+	const char* unique = "DE C0 AD 0B EF BE AD DE 11 22 33 44 55 66 77 88";
+
+	struct image_source
+	{
+		const char* name;
+		void (*fill)(uint8_t*, size_t, random_bytes&);
+		const std::vector<signature>* signatures;
+		const std::vector<engine>* engines;
+	};
+
+	const image_source sources[] =
+	{
+		{ "random", FillRandom, &x86Signatures, &engines },
+		{ "x86", FillX86, &x86Signatures, &engines },
+		{ "arm64", FillArm64, &arm64Signatures, &arm64Engines },
+	};
+
+	// the hints are keyed by the pattern text and every image is mapped at the same address:
+	// each run after the first would be a hint lookup returning the matches of an earlier image
+	if (hintCache)
+	{
+		printf("\nrange scans skipped: built with PATTERNS_USE_HINTS\n");
+	}
+	else
+	{
+		PrintHeader("range scans");
+		for (auto& source : sources)
+		{
+			void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (memory == MAP_FAILED)
+			{
+				perror("mmap");
+				return 1;
+			}
+
+			corpus image = { source.name, static_cast<uint8_t*>(memory), size };
+			random_bytes random(seed);
+			source.fill(image.data, image.size, random);
+
+			// a few real instances of every signature, 4 byte aligned so aligned4 finds them too
+			for (auto& sig : *source.signatures)
+			{
+				for (int i = 0; i < 8; i++)
+				{
+					Plant(image.data + ((random.next() % (size - 64)) & ~size_t(3)), sig.pattern, random);
+				}
+			}
+			Plant(image.data + (size / 4 * 3), unique, random);
+
+			RunScans(image, *source.signatures, *source.engines, runs);
+			RunFirstMatch(image, unique, image.data + (size / 4 * 3), runs);
+
+			// the anonymous images are always resident, the x86 one is scanned again from a file with cold pages
+			if (source.fill == FillX86 && !RunColdFile(image, *source.signatures, fileEngines, runs))
+			{
+				munmap(memory, size);
+				return 1;
+			}
+
+			munmap(memory, size);
+		}
+
+		auto prefetch = hook::get_prefetch_stats();
+		printf("\nprefetch: resident pages %llu, cold pages %llu, prefetched pages %llu, faults avoided %llu\n",
+			static_cast<unsigned long long>(prefetch.resident_pages), static_cast<unsigned long long>(prefetch.cold_pages),
+			static_cast<unsigned long long>(prefetch.prefetched_pages), static_cast<unsigned long long>(prefetch.faults_avoided));
+	}
+
+	RunMetadata(runs);
+
+	if (failures != 0)
+	{
+		printf("\n%d scans differ from the byte by byte search\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -59,7 +59,7 @@ $(call message, Enable use XDL library)
 	$(MY_XDL_PATH)/xdl_linker.c $(MY_XDL_PATH)/xdl_lzma.c $(MY_XDL_PATH)/xdl_util.c
 	
 	LOCAL_EXPORT_C_INCLUDES += $(MY_XDL_PATH)/include
-	LOCAL_C_INCLUDES += $(MY_XDL_PATH)/include
+	LOCAL_C_INCLUDES += $(MY_XDL_PATH)/include $(MY_XDL_PATH)
 	
 	LOCAL_CXXFLAGS += -DPATTERNS_USE_XDL
 endif
@@ -74,6 +74,16 @@ $(call message, "Enable serialize hints")
 	LOCAL_CXXFLAGS += -DPATTERNS_CAN_SERIALIZE_HINTS
 endif
 
+ifeq ($(PATTERNS_USE_STATS), 1)
+$(call message, Enable pattern statistics)
+	LOCAL_CXXFLAGS += -DPATTERNS_USE_STATS
+endif
+
+ifeq ($(PATTERNS_USE_TRACE), 1)
+$(call message, Enable scan tracing)
+	LOCAL_CXXFLAGS += -DPATTERNS_USE_TRACE
+endif
+
 ifeq ($(NDK_DEBUG), 1)
 $(call message, Debug mode)
 	LOCAL_CXXFLAGS += -O0 -g -DDEBUG -DPATTERNS_ANDROID_LOGGING
@@ -32,13 +32,20 @@
 #ifndef HOOKING_PATTERNS
 #define HOOKING_PATTERNS
 
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
 #include <vector>
 #include <string>
 #include <sstream>
 #include <iomanip>
 #include <string_view>
 #include <initializer_list>
+#include <type_traits>
 
 #if defined(_CPPUNWIND) && !defined(PATTERNS_SUPPRESS_EXCEPTIONS)
 #define PATTERNS_ENABLE_EXCEPTIONS
@@ -69,10 +76,238 @@ namespace hook
 	};
 #endif
 
+	// residency scheduler counters (process wide), see basic_pattern::prefetch
+	struct prefetch_stats
+	{
+		uint64_t resident_pages; // pages already in memory, scanned first
+		uint64_t cold_pages; // pages not in memory when the scan was planned
+		uint64_t prefetched_pages; // pages advised with MADV_WILLNEED
+		uint64_t faults_avoided; // cold pages which were resident when the scanner reached them
+	};
+
+	prefetch_stats get_prefetch_stats();
+
+	// mappings which are not ELF modules, scanned by make_memory_pattern; only readable ones, of min_size to max_size bytes
+	struct memory_sources
+	{
+		enum : uint32_t
+		{
+			jit = 1,       // anonymous r-x: the ART JIT code cache, memfd and anonymous code of other JITs
+			heap = 2,      // [heap] and the allocator arenas ([anon:libc_malloc], [anon:scudo:*], [anon:jemalloc*])
+			anonymous = 4, // every other rw anonymous mapping
+		};
+
+		uint32_t kinds = jit;
+		size_t min_size = 0;
+		size_t max_size = SIZE_MAX;
+	};
+
+	// the mappings are read from /proc/self/maps once per module load / unload,
+	// call this after mapping memory (a JIT region, a large allocation) to be scanned by make_memory_pattern
+	void refresh_memory_maps();
+
+	// a hint as module + offset: load addresses change from run to run, see basic_pattern::get_hints
+	struct pattern_hint
+	{
+		uint64_t hash;
+		std::string lib_name;
+		uintptr_t offset; // from the load address of lib_name
+	};
+
+#ifdef PATTERNS_ANDROID_LOGGING
+	// diagnostics are buffered in memory and formatted on flush_log, records below the level are dropped
+	enum class log_level : int
+	{
+		info,
+		warn,
+		error,
+		off,
+	};
+
+	enum class log_sink
+	{
+		logcat, // stderr when not on Android
+		console, // stderr
+		file, // appended to path
+	};
+
+	void set_log_level(log_level level);
+
+	// writes the buffered records oldest first and empties the buffer, returns how many were written
+	size_t flush_log(log_sink sink = log_sink::logcat, const std::string& path = {});
+#endif
+
+#if PATTERNS_USE_STATS
+	// scan counters of one pattern (basic_pattern::stats) or of the whole process (get_pattern_stats)
+	struct pattern_stats
+	{
+		uint64_t bytes_scanned; // readable bytes handed to the scanner
+		uint64_t ranges_visited; // readable ranges after the library and section filters
+		uint64_t candidates; // positions verified against the whole pattern
+		uint64_t matches;
+		uint64_t hint_hits;
+		uint64_t hint_misses;
+		uint64_t metadata_ns; // module enumeration and ELF parsing
+		uint64_t hint_ns;
+		uint64_t scan_ns;
+	};
+
+	pattern_stats get_pattern_stats();
+
+	// the top slowest call sites (metadata + hint + scan time), one line each
+	std::string dump_pattern_stats(size_t top = 10);
+
+	// counters of the patterns created at one source line (or under one tag) with the same text
+	struct call_site_stats
+	{
+		std::string file;
+		uint32_t line;
+		std::string tag; // innermost pattern_tag of the creating thread, empty: none
+		std::string pattern;
+		std::string lib_name;
+		uint64_t calls; // resolves
+		pattern_stats stats;
+	};
+
+	// slowest first
+	std::vector<call_site_stats> get_call_site_stats();
+
+	// get_call_site_stats as CSV with a header row, written to path when given
+	std::string dump_call_site_csv(const std::string& path = {});
+
+	// attributes the patterns created by this thread in its lifetime to tag, nested tags replace the outer one
+	class pattern_tag
+	{
+	public:
+		explicit pattern_tag(std::string tag);
+		~pattern_tag();
+
+		pattern_tag(const pattern_tag&) = delete;
+		pattern_tag& operator=(const pattern_tag&) = delete;
+
+	private:
+		std::string m_previous;
+	};
+#endif
+
+#if PATTERNS_USE_TRACE
+	// timeline of module enumeration, ELF parsing, hint lookup, scan planning and range scans,
+	// written as Chrome trace JSON (chrome://tracing, ui.perfetto.dev)
+	void start_trace(size_t events_per_thread = 16384);
+	void stop_trace();
+	bool write_trace(const std::string& path);
+#endif
+
+	// where a pattern was created, the default arguments capture the caller
+	struct pattern_location
+	{
+		const char* file;
+		uint32_t line;
+
+		static constexpr pattern_location current(const char* file = __builtin_FILE(), uint32_t line = __builtin_LINE())
+		{
+			return { file, line };
+		}
+	};
+
+	// how selective a pattern is and what scanning it costs, see basic_pattern::analyze
+	struct pattern_analysis
+	{
+		size_t length; // pattern bytes
+		size_t fixed_bits; // bits compared
+		size_t leading_wildcards; // whole wildcard bytes at the start
+		size_t trailing_wildcards; // whole wildcard bytes at the end
+		double average_shift; // bytes skipped per window, from the byte frequencies of the ranges
+		double candidates_per_mb; // windows verified against the whole pattern, estimated
+		double false_matches; // expected random matches in the ranges
+		std::string engine; // engine the current options select
+		size_t scanned_bytes; // readable bytes of the ranges, 0: no range
+		int64_t matches; // real matches in the ranges, -1: not measured
+		double scan_ms;
+		std::vector<std::string> warnings;
+		std::string suggestion; // tighter or shorter variant with the same matches, empty: none
+		ptrdiff_t suggestion_offset; // add to the address of a suggestion match
+	};
+
+	std::string to_string(const pattern_analysis& analysis);
+
+	// analysis of every signature of a file (one per line, '#' comments) against lib_name (process by default)
+	std::string analyze_signatures(const std::string& path, const std::string& lib_name = {});
+
+	namespace details
+	{
+		class basic_pattern_impl;
+	}
+
+	// stops the scans it is given to (basic_pattern::cancellation), copies share the state
+	class cancellation_token
+	{
+	public:
+		cancellation_token()
+			: m_cancelled(std::make_shared<std::atomic<bool>>(false))
+		{
+		}
+
+		inline void cancel() const
+		{
+			m_cancelled->store(true, std::memory_order_relaxed);
+		}
+
+		inline bool cancelled() const
+		{
+			return m_cancelled->load(std::memory_order_relaxed);
+		}
+
+	private:
+		friend class details::basic_pattern_impl;
+
+		std::shared_ptr<std::atomic<bool>> m_cancelled;
+	};
+
+	// how far a deadline or a cancellation let the scan get
+	struct scan_progress
+	{
+		bool complete; // false: cut short, the next resolve resumes from here
+		size_t ranges_done; // readable ranges scanned to the end
+		uintptr_t resume_address; // first untested address of the interrupted range, 0: none
+		uint64_t bytes_scanned;
+	};
+
+	// "<name:type>" / "[name:type]" in a pattern: the field is read when the match is found
+	enum class capture_type : uint8_t
+	{
+		i8, u8, i16, u16, i32, u32, i64, u64,
+		rel8, rel32, // x86 displacement, relative to the end of the field
+		bl,          // arm64 B / BL (imm26, constrains the opcode)
+		adrp,        // arm64 ADRP (page, constrains the opcode)
+	};
+
+	struct pattern_capture
+	{
+		std::string name;
+		size_t offset; // from the start of the match
+		capture_type type;
+	};
+
 	class pattern_match
 	{
 	private:
 		void* m_pointer;
+		std::shared_ptr<const std::vector<pattern_capture>> m_captures;
+		std::vector<int64_t> m_values; // one per capture: the value, or the decoded displacement
+		size_t m_mismatches = 0;
+
+		inline size_t find_capture(std::string_view name) const
+		{
+			for (size_t i = 0; m_captures && i < m_captures->size(); i++)
+			{
+				if ((*m_captures)[i].name == name)
+				{
+					return i;
+				}
+			}
+			return SIZE_MAX;
+		}
 
 	public:
 		inline pattern_match(void* pointer)
@@ -80,12 +315,62 @@ namespace hook
 		{
 		}
 
+		inline pattern_match(void* pointer, std::shared_ptr<const std::vector<pattern_capture>> captures, std::vector<int64_t> values, size_t mismatches = 0)
+			: m_pointer(pointer), m_captures(std::move(captures)), m_values(std::move(values)), m_mismatches(mismatches)
+		{
+		}
+
 		template<typename T>
 		T* get(ptrdiff_t offset = 0) const
 		{
 			char* ptr = reinterpret_cast<char*>(m_pointer);
 			return reinterpret_cast<T*>(ptr + offset);
 		}
+
+		// differing bytes of an approximate match (max_mismatches), 0 for an exact one
+		inline size_t mismatches() const
+		{
+			return m_mismatches;
+		}
+
+		inline bool has_capture(std::string_view name) const
+		{
+			return find_capture(name) != SIZE_MAX;
+		}
+
+		// integers as read (sign extended for iN), rel8 / rel32 / bl / adrp as the byte displacement
+		template<typename T = int64_t>
+		T capture(std::string_view name) const
+		{
+			size_t index = find_capture(name);
+			assert(index != SIZE_MAX);
+			return (index != SIZE_MAX) ? static_cast<T>(m_values[index]) : T{};
+		}
+
+		// rel8 / rel32 / bl / adrp: the address they refer to (adrp: the page), integers: the value as an address
+		template<typename T = void>
+		T* target(std::string_view name) const
+		{
+			size_t index = find_capture(name);
+			assert(index != SIZE_MAX);
+			if (index == SIZE_MAX)
+			{
+				return nullptr;
+			}
+
+			const pattern_capture& entry = (*m_captures)[index];
+			uintptr_t field = reinterpret_cast<uintptr_t>(m_pointer) + entry.offset;
+			uintptr_t base = 0;
+			switch (entry.type)
+			{
+			case capture_type::rel8: base = field + 1; break;
+			case capture_type::rel32: base = field + 4; break;
+			case capture_type::bl: base = field; break;
+			case capture_type::adrp: base = field & ~uintptr_t(0xFFF); break;
+			default: break;
+			}
+			return reinterpret_cast<T*>(base + static_cast<uintptr_t>(m_values[index]));
+		}
 	};
 
 	namespace details
@@ -94,16 +379,69 @@ namespace hook
 
 		const std::string get_process_name();
 
+		// "[min-max]" between m_bytes[position - 1] and m_bytes[position]
+		struct pattern_gap
+		{
+			size_t position;
+			size_t min;
+			size_t max;
+		};
+
+		// "(48|4C)", "(40-4F)": the byte at position is one of bits (256-bit membership table),
+		// m_bytes / m_mask hold the bits all members share
+		struct pattern_class
+		{
+			size_t position;
+			uint64_t bits[4];
+
+			inline bool test(uint8_t value) const
+			{
+				return (bits[value >> 6] >> (value & 63)) & 1;
+			}
+		};
+
+		struct dirty_watch;
+
 		class basic_pattern_impl
 		{
 		protected:
 			std::basic_string<uint8_t> m_bytes;
 			std::basic_string<uint8_t> m_mask;
+			std::vector<pattern_gap> m_gaps;
+			std::vector<pattern_class> m_classes;
+			std::shared_ptr<const std::vector<pattern_capture>> m_captures;
 
 #if PATTERNS_USE_HINTS
 			uint64_t m_hash = 0;
 #endif
 
+#if PATTERNS_USE_HINTS && PATTERNS_CAN_SERIALIZE_HINTS
+			std::vector<uintptr_t> m_staleHints;
+#endif
+			size_t m_hintProximity = 0;
+
+			size_t m_align = 1;
+
+			size_t m_maxMismatches = 0;
+
+			memory_sources m_memorySources{ 0 }; // kinds 0: the ELF modules
+
+			bool m_incremental = false;
+			bool m_scannedAll = false; // the last scan saw every range, it was not cut short by a count or a deadline
+			std::shared_ptr<dirty_watch> m_dirtyWatch;
+
+#if PATTERNS_USE_TRACE
+			uint64_t m_traceId = 0;
+#endif
+
+#if PATTERNS_USE_STATS
+			pattern_stats m_stats{};
+			pattern_stats m_recorded{}; // the part of m_stats already added to the call site registry
+			std::string m_source;
+			pattern_location m_location{};
+			std::string m_tag;
+#endif
+
 			std::vector<pattern_match> m_matches;
 
 			bool m_matched = false;
@@ -112,21 +450,55 @@ namespace hook
 			uintptr_t m_rangeStart;
 			uintptr_t m_rangeEnd;
 
-			std::vector<const std::string> m_sectionNames;
+			std::vector<std::string> m_sectionNames;
 
 			bool m_findSection = false;
 			bool m_findExecutable = true;
+			bool m_functionStart = false;
+			bool m_safeRead = false;
+
+			size_t m_prefetchDistance = 0;
+			bool m_prefetchSequential = false;
 
-			std::vector<const std::string> m_ignoreLibrarys;
-			std::vector<const std::string> m_ignoreSections;
+			std::chrono::steady_clock::time_point m_deadline = std::chrono::steady_clock::time_point::max();
+			std::shared_ptr<std::atomic<bool>> m_cancelled;
+			scan_progress m_progress{};
+			std::vector<uintptr_t> m_scannedRanges; // begin of the readable ranges in m_progress.ranges_done
+
+			inline void SetCancellation(const cancellation_token& token)
+			{
+				m_cancelled = token.m_cancelled;
+			}
+
+			std::vector<std::string> m_ignoreLibrarys;
+			std::vector<std::string> m_ignoreSections;
 
 		protected:
-			void Initialize(std::string_view pattern);
+			void Initialize(std::string_view pattern, pattern_location location);
 
 			bool ConsiderHint(uintptr_t offset);
 
+			bool Wanted(const std::string& library, const std::string* section) const;
+
+			pattern_analysis Analyze();
+
+#if PATTERNS_USE_HINTS && PATTERNS_CAN_SERIALIZE_HINTS
+			bool ConsiderProximity();
+#endif
+
 			void EnsureMatches(uint32_t maxCount);
 
+			size_t Rescan();
+
+			// data holds the matched bytes (the match itself, or the copy they were compared in)
+			void AddMatch(uintptr_t address, const uint8_t* data, size_t mismatches = 0);
+
+#if PATTERNS_USE_STATS
+			void SetLocation(pattern_location location);
+
+			void RecordStats();
+#endif
+
 			inline pattern_match _get_internal(size_t index) const
 			{
 				return m_matches[index];
@@ -159,49 +531,55 @@ namespace hook
 			{
 			}
 
-			explicit basic_pattern_impl(std::string_view pattern)
+			explicit basic_pattern_impl(std::string_view pattern, pattern_location location = pattern_location::current())
 				: basic_pattern_impl()
 			{
-				Initialize(std::move(pattern));
+				Initialize(std::move(pattern), location);
 			}
 
-			inline basic_pattern_impl(void* module, std::string_view pattern)
+			inline basic_pattern_impl(void* module, std::string_view pattern, pattern_location location = pattern_location::current())
 				: basic_pattern_impl(reinterpret_cast<uintptr_t>(module))
 			{
-				Initialize(std::move(pattern));
+				Initialize(std::move(pattern), location);
 			}
 
-			inline basic_pattern_impl(uintptr_t begin, uintptr_t end, std::string_view pattern)
+			inline basic_pattern_impl(uintptr_t begin, uintptr_t end, std::string_view pattern, pattern_location location = pattern_location::current())
 				: basic_pattern_impl(begin, end)
 			{
-				Initialize(std::move(pattern));
+				Initialize(std::move(pattern), location);
 			}
 
-			inline basic_pattern_impl(const std::string& lib_name, void* module, std::string_view pattern)
+			inline basic_pattern_impl(const std::string& lib_name, void* module, std::string_view pattern, pattern_location location = pattern_location::current())
 				: basic_pattern_impl(lib_name, reinterpret_cast<uintptr_t>(module))
 			{
-				Initialize(std::move(pattern));
+				Initialize(std::move(pattern), location);
 			}
 			
-			inline basic_pattern_impl(const std::string& lib_name, uintptr_t begin, uintptr_t end, std::string_view pattern)
+			inline basic_pattern_impl(const std::string& lib_name, uintptr_t begin, uintptr_t end, std::string_view pattern, pattern_location location = pattern_location::current())
 				: basic_pattern_impl(lib_name, begin, end)
 			{
-				Initialize(std::move(pattern));
+				Initialize(std::move(pattern), location);
 			}
 
-			inline basic_pattern_impl(const std::string& lib_name, const std::string& section, std::string_view pattern)
+			inline basic_pattern_impl(const std::string& lib_name, const std::string& section, std::string_view pattern, pattern_location location = pattern_location::current())
 				: basic_pattern_impl(lib_name, section, 0)
 			{
-				Initialize(std::move(pattern));
+				Initialize(std::move(pattern), location);
 			}
 
-			inline basic_pattern_impl(const std::string& lib_name, const std::string& section, uintptr_t begin, uintptr_t end, std::string_view pattern)
+			inline basic_pattern_impl(const std::string& lib_name, const std::string& section, uintptr_t begin, uintptr_t end, std::string_view pattern, pattern_location location = pattern_location::current())
 				: basic_pattern_impl(lib_name, section, begin, end)
 			{
-				Initialize(std::move(pattern));
+				Initialize(std::move(pattern), location);
+			}
+
+			inline basic_pattern_impl(const memory_sources& sources, std::string_view pattern, pattern_location location = pattern_location::current())
+				: m_memorySources(sources), m_rangeStart(0), m_rangeEnd(0)
+			{
+				Initialize(std::move(pattern), location);
 			}
 
-			explicit basic_pattern_impl(const std::string& lib_or_section_name, std::string_view pattern)
+			explicit basic_pattern_impl(const std::string& lib_or_section_name, std::string_view pattern, pattern_location location = pattern_location::current())
 			{
 				if (lib_or_section_name.empty())
 				{
@@ -210,27 +588,34 @@ namespace hook
 				if (lib_or_section_name[0] != '.')
 				{
 					new(this) basic_pattern_impl(lib_or_section_name, get_process_base(lib_or_section_name));
-					Initialize(std::move(pattern));
+					Initialize(std::move(pattern), location);
 				}
 				else
 				{
-					new(this) basic_pattern_impl(get_process_name(), lib_or_section_name, std::move(pattern));
+					new(this) basic_pattern_impl(get_process_name(), lib_or_section_name, std::move(pattern), location);
 				}
 			}
 			
 			// Pretransformed patterns
-			inline basic_pattern_impl(const std::string& lib_name, std::basic_string_view<uint8_t> bytes, std::basic_string_view<uint8_t> mask)
+			inline basic_pattern_impl(const std::string& lib_name, std::basic_string_view<uint8_t> bytes, std::basic_string_view<uint8_t> mask, [[maybe_unused]] pattern_location location = pattern_location::current())
 				: basic_pattern_impl(lib_name, get_process_base(lib_name))
 			{
 				assert(bytes.length() == mask.length());
 				m_bytes = std::move(bytes);
 				m_mask = std::move(mask);
+#if PATTERNS_USE_STATS
+				SetLocation(location);
+#endif
 			}
 
 		protected:
 #if PATTERNS_USE_HINTS && PATTERNS_CAN_SERIALIZE_HINTS
 			// define a hint
 			static void hint(uint64_t hash, uintptr_t address);
+
+			static void hint(const pattern_hint& hint);
+
+			static std::vector<pattern_hint> get_hints();
 #endif
 		};
 	}
@@ -266,6 +651,108 @@ namespace hook
 			return std::forward<basic_pattern>(*this);
 		}
 
+		// only match at function entries (.eh_frame_hdr, .ARM.exidx, .dynsym, .symtab, .gnu_debugdata);
+		// the matches from hints are dropped
+		inline basic_pattern&& function_start(bool functionStart = true)
+		{
+			m_functionStart = functionStart;
+			m_matches.clear();
+			m_matched = false;
+			m_progress = {};
+			m_scannedRanges.clear();
+			return std::forward<basic_pattern>(*this);
+		}
+
+		// copy memory through process_vm_readv before comparing, for ranges with unknown residency
+		inline basic_pattern&& safe_read(bool safeRead = true)
+		{
+			m_safeRead = safeRead;
+			return std::forward<basic_pattern>(*this);
+		}
+
+		// scan resident pages first and madvise(MADV_WILLNEED) distance bytes ahead on cold pages,
+		// sequential: MADV_SEQUENTIAL on file-backed ranges while scanning, MADV_NORMAL afterwards
+		inline basic_pattern&& prefetch(size_t distance = 0x100000, bool sequential = false)
+		{
+			m_prefetchDistance = distance;
+			m_prefetchSequential = sequential;
+			return std::forward<basic_pattern>(*this);
+		}
+
+		// search up to maxRadius bytes around stale hints before the full scan, the hints follow the match
+		inline basic_pattern&& proximity(size_t maxRadius = 0x1000000)
+		{
+			m_hintProximity = maxRadius;
+			return std::forward<basic_pattern>(*this);
+		}
+
+		// also accept matches where up to count fixed bytes differ (ignored for patterns with gaps),
+		// pattern_match::mismatches() tells how many did; the exact matches from hints are dropped
+		inline basic_pattern&& max_mismatches(size_t count)
+		{
+			m_maxMismatches = count;
+			m_matches.clear();
+			m_matched = false;
+			m_progress = {};
+			m_scannedRanges.clear();
+			return std::forward<basic_pattern>(*this);
+		}
+
+		// watch the scanned ranges for writes: soft-dirty bits in /proc/self/pagemap (the clear through /proc/self/clear_refs
+		// is process wide), or page hashes where the kernel has none; rescan() then only looks at the written pages
+		inline basic_pattern&& incremental(bool enable = true)
+		{
+			m_incremental = enable;
+			return std::forward<basic_pattern>(*this);
+		}
+
+		// resolves every match again, once an incremental scan completed only around the pages written since the last one;
+		// returns the match count
+		inline size_t rescan()
+		{
+			return Rescan();
+		}
+
+		// stop scanning at when, checked every scan chunk; the matches so far are kept
+		// and the next resolve (size, count, get ...) resumes where the scan stopped
+		inline basic_pattern&& deadline(std::chrono::steady_clock::time_point when)
+		{
+			m_deadline = when;
+			return std::forward<basic_pattern>(*this);
+		}
+
+		// budget from now
+		template<typename Rep, typename Period>
+		inline basic_pattern&& deadline(std::chrono::duration<Rep, Period> budget)
+		{
+			return deadline(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(budget));
+		}
+
+		// stop scanning once token is cancelled, resumable like deadline
+		inline basic_pattern&& cancellation(const cancellation_token& token)
+		{
+			SetCancellation(token);
+			return std::forward<basic_pattern>(*this);
+		}
+
+		inline const scan_progress& progress() const
+		{
+			return m_progress;
+		}
+
+		// only match at addresses aligned to alignment (1, 2, 4, 8 ...),
+		// 0: per module from e_machine (AArch64: 4, ARM/Thumb: 2, others: 1); the matches from hints are dropped
+		inline basic_pattern&& aligned(size_t alignment = 0)
+		{
+			assert((alignment & (alignment - 1)) == 0);
+			m_align = alignment;
+			m_matches.clear();
+			m_matched = false;
+			m_progress = {};
+			m_scannedRanges.clear();
+			return std::forward<basic_pattern>(*this);
+		}
+
 		inline basic_pattern&& ignore_lib(std::initializer_list<const std::string> lib_names = {})
 		{
 			if (lib_names.size())
@@ -309,13 +796,32 @@ namespace hook
 			{
 				this->m_rangeStart = reinterpret_cast<uintptr_t>(module);
 				this->m_rangeEnd = 0;
+				this->m_memorySources = { 0 };
 			}
 
 			m_matches.clear();
 			m_matched = false;
+#if PATTERNS_USE_STATS
+			m_stats = {};
+			m_recorded = {};
+#endif
 			m_libName.clear();
 			m_findSection = false;
 			m_findExecutable = true;
+			m_functionStart = false;
+			m_safeRead = false;
+			m_prefetchDistance = 0;
+			m_prefetchSequential = false;
+			m_hintProximity = 0;
+			m_align = 1;
+			m_maxMismatches = 0;
+			m_deadline = std::chrono::steady_clock::time_point::max();
+			m_cancelled.reset();
+			m_progress = {};
+			m_scannedRanges.clear();
+			m_incremental = false;
+			m_scannedAll = false;
+			m_dirtyWatch.reset();
 			m_sectionNames.clear();
 			m_ignoreLibrarys.clear();
 			m_ignoreSections.clear();
@@ -333,6 +839,19 @@ namespace hook
 			return size() == 0;
 		}
 
+		// estimated candidate rate, skip table warnings, engine, real match count and a tighter variant
+		inline pattern_analysis analyze()
+		{
+			return Analyze();
+		}
+
+#if PATTERNS_USE_STATS
+		inline const pattern_stats& stats() const
+		{
+			return m_stats;
+		}
+#endif
+
 		inline pattern_match get(size_t index)
 		{
 			EnsureMatches(UINT32_MAX);
@@ -368,47 +887,65 @@ namespace hook
 		{
 			details::basic_pattern_impl::hint(hash, address);
 		}
+
+		// define a hint saved by an earlier run, it is rebased onto the current load address of its module
+		static void hint(const pattern_hint& hint)
+		{
+			details::basic_pattern_impl::hint(hint);
+		}
+
+		// the hints of this run as module + offset, to be saved for the next one
+		static std::vector<pattern_hint> get_hints()
+		{
+			return details::basic_pattern_impl::get_hints();
+		}
 #endif
 	};
 
 	using pattern = basic_pattern<assert_err_policy>;
 
-	inline auto make_module_pattern(void* module, std::string_view bytes)
+	inline auto make_module_pattern(void* module, std::string_view bytes, pattern_location location = pattern_location::current())
 	{
-		return pattern(module, std::move(bytes));
+		return pattern(module, std::move(bytes), location);
 	}
 	
-	inline auto make_module_pattern(const std::string& lib_name, void* module, std::string_view bytes)
+	inline auto make_module_pattern(const std::string& lib_name, void* module, std::string_view bytes, pattern_location location = pattern_location::current())
 	{
-		return pattern(lib_name, module, std::move(bytes));
+		return pattern(lib_name, module, std::move(bytes), location);
 	}
 	
-	inline auto make_range_pattern(uintptr_t begin, uintptr_t end, std::string_view bytes)
+	inline auto make_range_pattern(uintptr_t begin, uintptr_t end, std::string_view bytes, pattern_location location = pattern_location::current())
 	{
-		return pattern(begin, end, std::move(bytes));
+		return pattern(begin, end, std::move(bytes), location);
 	}
 
-	inline auto make_range_pattern(const std::string& lib_name, uintptr_t begin, uintptr_t end, std::string_view bytes)
+	inline auto make_range_pattern(const std::string& lib_name, uintptr_t begin, uintptr_t end, std::string_view bytes, pattern_location location = pattern_location::current())
 	{
-		return pattern(lib_name, begin, end, std::move(bytes));
+		return pattern(lib_name, begin, end, std::move(bytes), location);
 	}
 	
-	inline auto make_section_pattern(const std::string& section, std::string_view bytes)
+	// anonymous / heap / JIT mappings, e.g. make_memory_pattern({ memory_sources::jit | memory_sources::heap }, "...")
+	inline auto make_memory_pattern(const memory_sources& sources, std::string_view bytes, pattern_location location = pattern_location::current())
 	{
-		return pattern(section, std::move(bytes));
+		return pattern(sources, std::move(bytes), location);
+	}
+
+	inline auto make_section_pattern(const std::string& section, std::string_view bytes, pattern_location location = pattern_location::current())
+	{
+		return pattern(section, std::move(bytes), location);
 	}
 	
-	inline auto make_section_pattern(const std::string& lib_name, const std::string& section, std::string_view bytes)
+	inline auto make_section_pattern(const std::string& lib_name, const std::string& section, std::string_view bytes, pattern_location location = pattern_location::current())
 	{
-		return pattern(lib_name, section, std::move(bytes));
+		return pattern(lib_name, section, std::move(bytes), location);
 	}
 
-	inline auto make_section_pattern(const std::string& lib_name, const std::string& section, uintptr_t begin, uintptr_t end, std::string_view bytes)
+	inline auto make_section_pattern(const std::string& lib_name, const std::string& section, uintptr_t begin, uintptr_t end, std::string_view bytes, pattern_location location = pattern_location::current())
 	{
-		return pattern(lib_name, section, begin, end, std::move(bytes));
+		return pattern(lib_name, section, begin, end, std::move(bytes), location);
 	}
 	
-	inline auto make_string_pattern(uintptr_t begin, uintptr_t end, const std::string& str)
+	inline auto make_string_pattern(uintptr_t begin, uintptr_t end, const std::string& str, pattern_location location = pattern_location::current())
 	{
 		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(str.data());
 		std::stringstream ss;
@@ -418,10 +955,10 @@ namespace hook
 		{
 			ss << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(bytes[i]) << " ";
 		}
-		return pattern(begin, end, ss.str());
+		return pattern(begin, end, ss.str(), location);
 	}
 
-	inline auto make_string_pattern(const std::string& lib_name, uintptr_t begin, uintptr_t end, const std::string& str)
+	inline auto make_string_pattern(const std::string& lib_name, uintptr_t begin, uintptr_t end, const std::string& str, pattern_location location = pattern_location::current())
 	{
 		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(str.data());
 		std::stringstream ss;
@@ -431,10 +968,10 @@ namespace hook
 		{
 			ss << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(bytes[i]) << " ";
 		}
-		return pattern(lib_name, begin, end, ss.str());
+		return pattern(lib_name, begin, end, ss.str(), location);
 	}
 
-	inline auto make_string_pattern(const std::string& lib_or_section_name, const std::string& str)
+	inline auto make_string_pattern(const std::string& lib_or_section_name, const std::string& str, pattern_location location = pattern_location::current())
 	{
 		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(str.data());
 		std::stringstream ss;
@@ -444,10 +981,10 @@ namespace hook
 		{
 			ss << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(bytes[i]) << " ";
 		}
-		return pattern(lib_or_section_name, ss.str());
+		return pattern(lib_or_section_name, ss.str(), location);
 	}
 
-	inline auto make_string_pattern(const std::string& lib_name, const std::string& section, const std::string& str)
+	inline auto make_string_pattern(const std::string& lib_name, const std::string& section, const std::string& str, pattern_location location = pattern_location::current())
 	{
 		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(str.data());
 		std::stringstream ss;
@@ -457,10 +994,10 @@ namespace hook
 		{
 			ss << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(bytes[i]) << " ";
 		}
-		return pattern(lib_name, section, ss.str());
+		return pattern(lib_name, section, ss.str(), location);
 	}
 	
-	inline auto make_string_pattern(const std::string& lib_name, const std::string& section, uintptr_t begin, uintptr_t end, const std::string& str)
+	inline auto make_string_pattern(const std::string& lib_name, const std::string& section, uintptr_t begin, uintptr_t end, const std::string& str, pattern_location location = pattern_location::current())
 	{
 		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(str.data());
 		std::stringstream ss;
@@ -470,11 +1007,11 @@ namespace hook
 		{
 			ss << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(bytes[i]) << " ";
 		}
-		return pattern(lib_name, section, begin, end, ss.str());
+		return pattern(lib_name, section, begin, end, ss.str(), location);
 	}
 
 	template <typename T>
-	inline auto make_data_pattern(const std::string& lib_name, const T& data)
+	inline auto make_data_pattern(const std::string& lib_name, const T& data, pattern_location location = pattern_location::current())
 	{
 		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&data);
 		std::stringstream ss;
@@ -484,11 +1021,11 @@ namespace hook
 		{
 			ss << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(bytes[i]) << " ";
 		}
-		return pattern(lib_name, ss.str());
+		return pattern(lib_name, ss.str(), location);
 	}
 	
 	template <typename T>
-	inline auto make_data_pattern(uintptr_t begin, uintptr_t end, const T& data)
+	inline auto make_data_pattern(uintptr_t begin, uintptr_t end, const T& data, pattern_location location = pattern_location::current())
 	{
 		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&data);
 		std::stringstream ss;
@@ -498,11 +1035,11 @@ namespace hook
 		{
 			ss << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(bytes[i]) << " ";
 		}
-		return pattern(begin, end, ss.str());
+		return pattern(begin, end, ss.str(), location);
 	}
 	
 	template <typename T>
-	inline auto make_data_pattern(const std::string& lib_name, const std::string& section, const T& data)
+	inline auto make_data_pattern(const std::string& lib_name, const std::string& section, const T& data, pattern_location location = pattern_location::current())
 	{
 		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&data);
 		std::stringstream ss;
@@ -512,11 +1049,11 @@ namespace hook
 		{
 			ss << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(bytes[i]) << " ";
 		}
-		return pattern(lib_name, section, ss.str());
+		return pattern(lib_name, section, ss.str(), location);
 	}
 
 	template <typename T>
-	inline auto make_data_pattern(const std::string& lib_name, const std::string& section, uintptr_t begin, uintptr_t end, const T& data)
+	inline auto make_data_pattern(const std::string& lib_name, const std::string& section, uintptr_t begin, uintptr_t end, const T& data, pattern_location location = pattern_location::current())
 	{
 		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&data);
 		std::stringstream ss;
@@ -526,70 +1063,324 @@ namespace hook
 		{
 			ss << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(bytes[i]) << " ";
 		}
-		return pattern(lib_name, section, begin, end, ss.str());
+		return pattern(lib_name, section, begin, end, ss.str(), location);
 	}
 	
 	template<typename T = void>
-	inline auto get_pattern(std::string_view pattern_string, ptrdiff_t offset = 0)
+	inline auto get_pattern(std::string_view pattern_string, ptrdiff_t offset = 0, pattern_location location = pattern_location::current())
 	{
-		return pattern(std::move(pattern_string)).get_first<T>(offset);
+		return pattern(std::move(pattern_string), location).get_first<T>(offset);
 	}
 
-	inline auto module_pattern(void* module, std::string_view bytes)
+	inline auto module_pattern(void* module, std::string_view bytes, pattern_location location = pattern_location::current())
 	{
-		return make_module_pattern(module, std::move(bytes));
+		return make_module_pattern(module, std::move(bytes), location);
 	}
 
-	inline auto range_pattern(uintptr_t begin, uintptr_t end, std::string_view bytes)
+	inline auto range_pattern(uintptr_t begin, uintptr_t end, std::string_view bytes, pattern_location location = pattern_location::current())
 	{
-		return make_range_pattern(begin, end, std::move(bytes));
+		return make_range_pattern(begin, end, std::move(bytes), location);
 	}
 	
-	inline auto section_pattern(const std::string& section, std::string_view bytes)
+	inline auto section_pattern(const std::string& section, std::string_view bytes, pattern_location location = pattern_location::current())
 	{
-		return make_section_pattern(section, std::move(bytes));
+		return make_section_pattern(section, std::move(bytes), location);
 	}
 	
+	// deferred patterns: resolved in one batched scan when their library gets loaded
+	// count: stop after count matches, executable: only scan executable segments
+	// priority > 0: resolved first, highest first, each with a targeted scan (hints, stopping at count) of the segments the batch scans,
+	// and called back before the batched scan of the priority 0 patterns of every module
+	using deferred_callback = std::function<void(const std::vector<pattern_match>& matches)>;
+
+	size_t register_deferred_pattern(const std::string& lib_name, std::string_view pattern, deferred_callback callback, uint32_t count = UINT32_MAX, bool executable = true, int priority = 0);
+
+	struct deferred_request
+	{
+		std::string lib_name;
+		std::string pattern;
+		deferred_callback callback;
+		uint32_t count = UINT32_MAX;
+		bool executable = true;
+		int priority = 0;
+	};
+
+	// registers every request before the first resolve, ids in request order (0: rejected)
+	std::vector<size_t> register_deferred_patterns(std::vector<deferred_request> requests);
+
+	bool unregister_deferred_pattern(size_t id);
+
+	// checks the dl_iterate_phdr load counters and resolves the patterns of new modules, returns the resolved count
+	size_t resolve_deferred_patterns();
+
+	// dlopen shim, redirect dlopen / android_dlopen_ext here to resolve right after the load
+	void* deferred_dlopen(const char* filename, int flags);
+
+	// background check of the load counters every interval
+	bool start_deferred_watcher(std::chrono::milliseconds interval = std::chrono::milliseconds(5));
+
+	void stop_deferred_watcher();
+
+	// value scans: a first scan over rw memory keeps the slots where a typed value passes the predicate,
+	// every next scan re-reads only the pages which still hold candidates
+	enum class value_predicate : uint8_t
+	{
+		any,                                      // first scan only: every slot, the start value is unknown
+		equal, not_equal, less, greater, within,  // against a (within: a <= value <= b)
+		changed, unchanged, increased, decreased, // next scan only: against the value read by the last scan
+	};
+
+	namespace details
+	{
+		enum class value_type : uint8_t
+		{
+			i8, u8, i16, u16, i32, u32, i64, u64, f32, f64,
+		};
+
+		template<typename T>
+		constexpr value_type get_value_type()
+		{
+			static_assert(std::is_arithmetic<T>::value && sizeof(T) <= 8, "value_scan: integer or floating point types only");
+			if constexpr (std::is_floating_point<T>::value) return sizeof(T) == 4 ? value_type::f32 : value_type::f64;
+			else if constexpr (sizeof(T) == 1) return std::is_signed<T>::value ? value_type::i8 : value_type::u8;
+			else if constexpr (sizeof(T) == 2) return std::is_signed<T>::value ? value_type::i16 : value_type::u16;
+			else if constexpr (sizeof(T) == 4) return std::is_signed<T>::value ? value_type::i32 : value_type::u32;
+			else return std::is_signed<T>::value ? value_type::i64 : value_type::u64;
+		}
+
+		// mmap'd memory which memory_sources scans leave out, for the state of a value scan
+		void* allocate_private(size_t size);
+
+		void free_private(void* address, size_t size);
+
+		template<typename T>
+		struct private_allocator
+		{
+			using value_type = T;
+
+			private_allocator() = default;
+
+			template<typename U>
+			private_allocator(const private_allocator<U>&)
+			{
+			}
+
+			inline T* allocate(size_t count)
+			{
+				return static_cast<T*>(allocate_private(count * sizeof(T)));
+			}
+
+			inline void deallocate(T* address, size_t count)
+			{
+				free_private(address, count * sizeof(T));
+			}
+
+			template<typename U>
+			inline bool operator==(const private_allocator<U>&) const
+			{
+				return true;
+			}
+
+			template<typename U>
+			inline bool operator!=(const private_allocator<U>&) const
+			{
+				return false;
+			}
+		};
+
+		template<typename T>
+		using private_vector = std::vector<T, private_allocator<T>>;
+
+		class value_scan_impl
+		{
+		protected:
+			// a page with candidates, its bits are m_bits[index * m_wordsPerPage ...]
+			struct value_page
+			{
+				uintptr_t address;
+				size_t firstValue; // index of its first candidate in m_values
+			};
+
+			value_type m_type;
+			size_t m_valueSize;
+			size_t m_align;
+			memory_sources m_sources;
+
+			size_t m_wordsPerPage = 0;
+			size_t m_count = 0;
+			// kept out of the scanned memory, copies of the value would be found again
+			private_vector<value_page> m_pages;
+			private_vector<uint64_t> m_bits; // bit i: the slot at address + i * m_align
+			private_vector<uint8_t> m_values; // m_valueSize bytes per candidate as read by the last scan, in page and bit order
+
+			value_scan_impl(value_type type, size_t valueSize, const memory_sources& sources, size_t alignment);
+
+			size_t First(value_predicate predicate, const void* a, const void* b);
+
+			size_t Next(value_predicate predicate, const void* a, const void* b);
+		};
+	}
+
+	// slots are alignment apart (sizeof(T) by default) and never cross a page
+	template<typename T>
+	class value_scan : details::value_scan_impl
+	{
+	public:
+		explicit value_scan(const memory_sources& sources = { memory_sources::heap | memory_sources::anonymous }, size_t alignment = sizeof(T))
+			: value_scan_impl(details::get_value_type<T>(), sizeof(T), sources, alignment)
+		{
+		}
+
+		// drops the candidates of an earlier scan, returns the candidate count
+		inline size_t first(value_predicate predicate, T a = T{}, T b = T{})
+		{
+			return First(predicate, &a, &b);
+		}
+
+		// narrows the candidates, returns how many are left
+		inline size_t next(value_predicate predicate, T a = T{}, T b = T{})
+		{
+			return Next(predicate, &a, &b);
+		}
+
+		inline size_t size() const
+		{
+			return m_count;
+		}
+
+		// callback(T* address, T value): value as read by the last scan
+		template<typename Callback>
+		void for_each(Callback&& callback) const
+		{
+			size_t index = 0;
+			for (size_t page = 0; page < m_pages.size(); page++)
+			{
+				for (size_t word = 0; word < m_wordsPerPage; word++)
+				{
+					for (uint64_t bits = m_bits[page * m_wordsPerPage + word]; bits != 0; bits &= bits - 1)
+					{
+						const size_t slot = word * 64 + __builtin_ctzll(bits);
+						T value;
+						memcpy(&value, m_values.data() + index++ * sizeof(T), sizeof(T));
+						callback(reinterpret_cast<T*>(m_pages[page].address + slot * m_align), value);
+					}
+				}
+			}
+		}
+
+		std::vector<T*> addresses(size_t count = SIZE_MAX) const
+		{
+			std::vector<T*> result;
+			for_each([&](T* address, T)
+			{
+				if (result.size() < count)
+				{
+					result.push_back(address);
+				}
+			});
+			return result;
+		}
+	};
+
+	// batched writes into code or data: the pages written are grouped into runs of adjacent pages, each run is made
+	// writable once, written, set back to the protections of the cached maps table and flushed from the instruction
+	// cache once; the bytes are copied when a write is queued
+	class patch_transaction
+	{
+	private:
+		struct patch_write
+		{
+			uintptr_t address;
+			std::basic_string<uint8_t> bytes;
+			std::basic_string<uint8_t> original; // read by commit, written back by revert
+		};
+
+		std::vector<patch_write> m_writes;
+		bool m_committed = false;
+
+		bool Apply(bool revert);
+
+	public:
+		patch_transaction& write(void* address, const void* data, size_t size);
+
+		inline patch_transaction& write(void* address, std::initializer_list<uint8_t> bytes)
+		{
+			return write(address, bytes.begin(), bytes.size());
+		}
+
+		inline patch_transaction& write(const pattern_match& match, ptrdiff_t offset, std::initializer_list<uint8_t> bytes)
+		{
+			return write(match.get<void>(offset), bytes.begin(), bytes.size());
+		}
+
+		template<typename T>
+		inline patch_transaction& put(void* address, const T& value)
+		{
+			return write(address, &value, sizeof(T));
+		}
+
+		template<typename T>
+		inline patch_transaction& put(const pattern_match& match, ptrdiff_t offset, const T& value)
+		{
+			return write(match.get<void>(offset), &value, sizeof(T));
+		}
+
+		patch_transaction& fill(void* address, uint8_t value, size_t size);
+
+		inline size_t size() const
+		{
+			return m_writes.size();
+		}
+
+		// applies every write in order, false if a run could not be made writable (the other runs are still written)
+		bool commit();
+
+		// writes back the bytes commit replaced, last write first
+		bool revert();
+
+		void clear();
+	};
+
 	namespace txn
 	{
 		using pattern = hook::basic_pattern<exception_err_policy>;
 
-		inline auto make_module_pattern(void* module, std::string_view bytes)
+		inline auto make_module_pattern(void* module, std::string_view bytes, pattern_location location = pattern_location::current())
 		{
-			return pattern(module, std::move(bytes));
+			return pattern(module, std::move(bytes), location);
 		}
 
-		inline auto make_module_pattern(const std::string& lib_name, void* module, std::string_view bytes)
+		inline auto make_module_pattern(const std::string& lib_name, void* module, std::string_view bytes, pattern_location location = pattern_location::current())
 		{
-			return pattern(lib_name, module, std::move(bytes));
+			return pattern(lib_name, module, std::move(bytes), location);
 		}
 		
-		inline auto make_range_pattern(uintptr_t begin, uintptr_t end, std::string_view bytes)
+		inline auto make_range_pattern(uintptr_t begin, uintptr_t end, std::string_view bytes, pattern_location location = pattern_location::current())
 		{
-			return pattern(begin, end, std::move(bytes));
+			return pattern(begin, end, std::move(bytes), location);
 		}
 		
-		inline auto make_range_pattern(const std::string& lib_name, uintptr_t begin, uintptr_t end, std::string_view bytes)
+		inline auto make_range_pattern(const std::string& lib_name, uintptr_t begin, uintptr_t end, std::string_view bytes, pattern_location location = pattern_location::current())
 		{
-			return pattern(lib_name, begin, end, std::move(bytes));
+			return pattern(lib_name, begin, end, std::move(bytes), location);
 		}
 
-		inline auto make_section_pattern(const std::string& section, std::string_view bytes)
+		inline auto make_section_pattern(const std::string& section, std::string_view bytes, pattern_location location = pattern_location::current())
 		{
-			return pattern(section, std::move(bytes));
+			return pattern(section, std::move(bytes), location);
 		}
 
-		inline auto make_section_pattern(const std::string& lib_name, const std::string& section, std::string_view bytes)
+		inline auto make_section_pattern(const std::string& lib_name, const std::string& section, std::string_view bytes, pattern_location location = pattern_location::current())
 		{
-			return pattern(lib_name, section, std::move(bytes));
+			return pattern(lib_name, section, std::move(bytes), location);
 		}
 
-		inline auto make_section_pattern(const std::string& lib_name, const std::string& section, uintptr_t begin, uintptr_t end, std::string_view bytes)
+		inline auto make_section_pattern(const std::string& lib_name, const std::string& section, uintptr_t begin, uintptr_t end, std::string_view bytes, pattern_location location = pattern_location::current())
 		{
-			return pattern(lib_name, section, begin, end, std::move(bytes));
+			return pattern(lib_name, section, begin, end, std::move(bytes), location);
 		}
 
-		inline auto make_string_pattern(uintptr_t begin, uintptr_t end, const std::string& str)
+		inline auto make_string_pattern(uintptr_t begin, uintptr_t end, const std::string& str, pattern_location location = pattern_location::current())
 		{
 			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(str.data());
 			std::stringstream ss;
@@ -599,10 +1390,10 @@ namespace hook
 			{
 				ss << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(bytes[i]) << " ";
 			}
-			return pattern(begin, end, ss.str());
+			return pattern(begin, end, ss.str(), location);
 		}
 
-		inline auto make_string_pattern(const std::string& lib_name, uintptr_t begin, uintptr_t end, const std::string& str)
+		inline auto make_string_pattern(const std::string& lib_name, uintptr_t begin, uintptr_t end, const std::string& str, pattern_location location = pattern_location::current())
 		{
 			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(str.data());
 			std::stringstream ss;
@@ -612,10 +1403,10 @@ namespace hook
 			{
 				ss << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(bytes[i]) << " ";
 			}
-			return pattern(lib_name, begin, end, ss.str());
+			return pattern(lib_name, begin, end, ss.str(), location);
 		}
 
-		inline auto make_string_pattern(const std::string& lib_or_section_name, const std::string& str)
+		inline auto make_string_pattern(const std::string& lib_or_section_name, const std::string& str, pattern_location location = pattern_location::current())
 		{
 			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(str.data());
 			std::stringstream ss;
@@ -625,10 +1416,10 @@ namespace hook
 			{
 				ss << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(bytes[i]) << " ";
 			}
-			return pattern(lib_or_section_name, ss.str());
+			return pattern(lib_or_section_name, ss.str(), location);
 		}
 
-		inline auto make_string_pattern(const std::string& lib_name, const std::string& section, const std::string& str)
+		inline auto make_string_pattern(const std::string& lib_name, const std::string& section, const std::string& str, pattern_location location = pattern_location::current())
 		{
 			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(str.data());
 			std::stringstream ss;
@@ -638,10 +1429,10 @@ namespace hook
 			{
 				ss << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(bytes[i]) << " ";
 			}
-			return pattern(lib_name, section, ss.str());
+			return pattern(lib_name, section, ss.str(), location);
 		}
 
-		inline auto make_string_pattern(const std::string& lib_name, const std::string& section, uintptr_t begin, uintptr_t end, const std::string& str)
+		inline auto make_string_pattern(const std::string& lib_name, const std::string& section, uintptr_t begin, uintptr_t end, const std::string& str, pattern_location location = pattern_location::current())
 		{
 			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(str.data());
 			std::stringstream ss;
@@ -651,11 +1442,11 @@ namespace hook
 			{
 				ss << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(bytes[i]) << " ";
 			}
-			return pattern(lib_name, section, begin, end, ss.str());
+			return pattern(lib_name, section, begin, end, ss.str(), location);
 		}
 
 		template <typename T>
-		inline auto make_data_pattern(const std::string& lib_name, const T& data)
+		inline auto make_data_pattern(const std::string& lib_name, const T& data, pattern_location location = pattern_location::current())
 		{
 			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&data);
 			std::stringstream ss;
@@ -665,11 +1456,11 @@ namespace hook
 			{
 				ss << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(bytes[i]) << " ";
 			}
-			return pattern(lib_name, ss.str());
+			return pattern(lib_name, ss.str(), location);
 		}
 
 		template <typename T>
-		inline auto make_data_pattern(uintptr_t begin, uintptr_t end, const T& data)
+		inline auto make_data_pattern(uintptr_t begin, uintptr_t end, const T& data, pattern_location location = pattern_location::current())
 		{
 			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&data);
 			std::stringstream ss;
@@ -679,11 +1470,11 @@ namespace hook
 			{
 				ss << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(bytes[i]) << " ";
 			}
-			return pattern(begin, end, ss.str());
+			return pattern(begin, end, ss.str(), location);
 		}
 
 		template <typename T>
-		inline auto make_data_pattern(const std::string& lib_name, const std::string& section, const T& data)
+		inline auto make_data_pattern(const std::string& lib_name, const std::string& section, const T& data, pattern_location location = pattern_location::current())
 		{
 			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&data);
 			std::stringstream ss;
@@ -693,11 +1484,11 @@ namespace hook
 			{
 				ss << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(bytes[i]) << " ";
 			}
-			return pattern(lib_name, section, ss.str());
+			return pattern(lib_name, section, ss.str(), location);
 		}
 
 		template <typename T>
-		inline auto make_data_pattern(const std::string& lib_name, const std::string& section, uintptr_t begin, uintptr_t end, const T& data)
+		inline auto make_data_pattern(const std::string& lib_name, const std::string& section, uintptr_t begin, uintptr_t end, const T& data, pattern_location location = pattern_location::current())
 		{
 			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&data);
 			std::stringstream ss;
@@ -707,28 +1498,28 @@ namespace hook
 			{
 				ss << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(bytes[i]) << " ";
 			}
-			return pattern(lib_name, section, begin, end, ss.str());
+			return pattern(lib_name, section, begin, end, ss.str(), location);
 		}
 		
 		template<typename T = void>
-		inline auto get_pattern(std::string_view pattern_string, ptrdiff_t offset = 0)
+		inline auto get_pattern(std::string_view pattern_string, ptrdiff_t offset = 0, pattern_location location = pattern_location::current())
 		{
-			return pattern(std::move(pattern_string)).get_first<T>(offset);
+			return pattern(std::move(pattern_string), location).get_first<T>(offset);
 		}
 
-		inline auto module_pattern(void* module, std::string_view bytes)
+		inline auto module_pattern(void* module, std::string_view bytes, pattern_location location = pattern_location::current())
 		{
-			return make_module_pattern(module, std::move(bytes));
+			return txn::make_module_pattern(module, std::move(bytes), location);
 		}
 
-		inline auto range_pattern(uintptr_t begin, uintptr_t end, std::string_view bytes)
+		inline auto range_pattern(uintptr_t begin, uintptr_t end, std::string_view bytes, pattern_location location = pattern_location::current())
 		{
-			return make_range_pattern(begin, end, std::move(bytes));
+			return txn::make_range_pattern(begin, end, std::move(bytes), location);
 		}
 
-		inline auto section_pattern(const std::string& section, std::string_view bytes)
+		inline auto section_pattern(const std::string& section, std::string_view bytes, pattern_location location = pattern_location::current())
 		{
-			return make_section_pattern(section, std::move(bytes));
+			return txn::make_section_pattern(section, std::move(bytes), location);
 		}
 	}
 }
@@ -35,9 +35,25 @@
 #include <inttypes.h> 
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <cstring>
 #include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
+#include <future>
+#include <iomanip>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <tuple>
+#include <unordered_set>
 #include <utility>
 
 #ifdef PATTERNS_USE_XDL
@@ -48,6 +64,7 @@ void* cache = nullptr; \
 xdl_addr(reinterpret_cast<void*>(addr), &vname, &cache)
 #define PATTERNS_DL_ADDR_CLEAN xdl_addr_clean(&cache)
 #define PATTERNS_DL_ITERATE_PHDR(callback, data) xdl_iterate_phdr(callback, data, XDL_DEFAULT | XDL_FULL_PATHNAME)
+#include "xdl_lzma.h" // .gnu_debugdata
 #else
 #include <dlfcn.h>
 #include <link.h>
@@ -56,22 +73,376 @@ xdl_addr(reinterpret_cast<void*>(addr), &vname, &cache)
 dladdr(reinterpret_cast<void*>(addr), &vname)
 #define PATTERNS_DL_ADDR_CLEAN
 #define PATTERNS_DL_ITERATE_PHDR(callback, data) dl_iterate_phdr(callback, data)
-#if __ANDROID_API__ < 21
+#if defined(__ANDROID__) && __ANDROID_API__ < 21
 #error dl_iterate_phdr is not supported on this platform (android 4.4). Please use xDL. Enable PATTERNS_USE_XDL.
 #endif
 #endif // PATTERNS_USE_XDL
 
- // The Android logging library may potentially cause some performance overhead and affect the execution speed of the code. 
- // However, it is recommended to enable it. If you don't need it, disable it.
+// Diagnostics go to an in-memory ring of binary records: the format string pointer and the raw arguments
+// (strings copied) are stored by the caller, formatting and the logcat/stderr/file writes only happen in flush_log.
+// Writers claim a slot with one atomic increment and never block, the oldest records are overwritten.
 #ifdef PATTERNS_ANDROID_LOGGING
+#ifdef __ANDROID__
 #include <android/log.h>
+#endif
 #define PATTERNS_NAME "Hooking.Patterns"
-#define PATTERNS_LOGI(text) ((void)__android_log_write(ANDROID_LOG_INFO, PATTERNS_NAME, text))
-#define PATTERNS_LOGE(text) ((void)__android_log_write(ANDROID_LOG_ERROR, PATTERNS_NAME, text))
-#define PATTERNS_LOGW(text) ((void)__android_log_write(ANDROID_LOG_WARN, PATTERNS_NAME, text))
-#define PATTERNS_LOGIS(text, ...) ((void)__android_log_print(ANDROID_LOG_INFO, PATTERNS_NAME, text, __VA_ARGS__))
-#define PATTERNS_LOGES(text, ...) ((void)__android_log_print(ANDROID_LOG_ERROR, PATTERNS_NAME, text, __VA_ARGS__))
-#define PATTERNS_LOGWS(text, ...) ((void)__android_log_print(ANDROID_LOG_WARN, PATTERNS_NAME, text, __VA_ARGS__))
+
+namespace hook
+{
+class log_ring
+{
+private:
+	enum arg_type : uint8_t
+	{
+		arg_signed,
+		arg_unsigned,
+		arg_double,
+		arg_string,
+		arg_absent, // did not fit into the payload
+	};
+
+	static constexpr size_t kRecords = 1024;
+	static constexpr size_t kPayload = 200;
+	static constexpr size_t kArgs = 12;
+
+	struct record
+	{
+		std::atomic<uint64_t> sequence{ 0 }; // index + 1 once complete
+		uint64_t time;
+		const char* format;
+		long tid;
+		uint8_t level;
+		uint8_t count;
+		uint8_t types[kArgs];
+		uint16_t offsets[kArgs];
+		uint8_t payload[kPayload];
+	};
+
+	struct writer
+	{
+		record& slot;
+		size_t left; // arguments still to be added, a string leaves 8 bytes for each of them
+		size_t used = 0;
+
+		// the whole argument or nothing, an argument which does not fit is stored as absent
+		void Put(arg_type type, const void* data, size_t size)
+		{
+			left -= (left != 0);
+			if (slot.count == kArgs)
+			{
+				return;
+			}
+			if (size > kPayload - used)
+			{
+				type = arg_absent;
+				size = 0;
+			}
+			slot.types[slot.count] = type;
+			slot.offsets[slot.count++] = static_cast<uint16_t>(used);
+			memcpy(slot.payload + used, data, size);
+			used += size;
+		}
+
+		// truncated to the room behind the later arguments, with its terminator
+		void Add(const char* value)
+		{
+			value = value ? value : "(null)";
+			const size_t reserved = std::min(kPayload, used + 8 * (left - (left != 0)) + 1);
+			const size_t length = std::min(strlen(value), kPayload - reserved);
+			if (length == 0 && *value != '\0')
+			{
+				Put(arg_absent, nullptr, 0);
+				return;
+			}
+
+			char copy[kPayload];
+			memcpy(copy, value, length);
+			copy[length] = '\0';
+			Put(arg_string, copy, length + 1);
+		}
+
+		void Add(char* value)
+		{
+			Add(static_cast<const char*>(value));
+		}
+
+		void Add(double value)
+		{
+			Put(arg_double, &value, sizeof(value));
+		}
+
+		void Add(const void* value)
+		{
+			uint64_t raw = reinterpret_cast<uintptr_t>(value);
+			Put(arg_unsigned, &raw, sizeof(raw));
+		}
+
+		template<typename T>
+		void Add(T value)
+		{
+			static_assert(std::is_integral<T>::value || std::is_enum<T>::value || std::is_floating_point<T>::value || std::is_pointer<T>::value, "unsupported log argument");
+			if constexpr (std::is_floating_point<T>::value)
+			{
+				Add(static_cast<double>(value));
+			}
+			else if constexpr (std::is_pointer<T>::value)
+			{
+				Add(static_cast<const void*>(value));
+			}
+			else if constexpr (std::is_signed<T>::value)
+			{
+				int64_t raw = static_cast<int64_t>(value);
+				Put(arg_signed, &raw, sizeof(raw));
+			}
+			else
+			{
+				uint64_t raw = static_cast<uint64_t>(value);
+				Put(arg_unsigned, &raw, sizeof(raw));
+			}
+		}
+	};
+
+	static record* getRecords()
+	{
+		static record* records = new record[kRecords];
+		return records;
+	}
+
+	static std::atomic<uint64_t>& getHead()
+	{
+		static std::atomic<uint64_t> head{ 0 };
+		return head;
+	}
+
+	static std::atomic<uint64_t>& getTail()
+	{
+		static std::atomic<uint64_t> tail{ 0 };
+		return tail;
+	}
+
+public:
+	static std::atomic<int>& getLevel()
+	{
+		static std::atomic<int> level{ static_cast<int>(log_level::info) };
+		return level;
+	}
+
+	template<typename... Args>
+	static void Write(log_level level, const char* format, Args... args)
+	{
+		if (static_cast<int>(level) < getLevel().load(std::memory_order_relaxed))
+		{
+			return;
+		}
+
+		const uint64_t index = getHead().fetch_add(1, std::memory_order_relaxed);
+		record& slot = getRecords()[index % kRecords];
+		slot.sequence.store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		slot.time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		slot.format = format;
+		slot.tid = syscall(__NR_gettid);
+		slot.level = static_cast<uint8_t>(level);
+		slot.count = 0;
+
+		[[maybe_unused]] writer out{ slot, sizeof...(args) };
+		(out.Add(args), ...);
+
+		slot.sequence.store(index + 1, std::memory_order_release);
+	}
+
+	// printf over the stored arguments, each conversion is formatted on its own with the width of the stored value
+	static std::string Format(const record& entry)
+	{
+		std::string text;
+		size_t next = 0;
+		char buffer[256];
+
+		// a stored value has to lie inside the payload, a string has to end in it
+		auto Stored = [&](size_t arg, size_t size) -> bool
+		{
+			return entry.types[arg] != arg_absent && entry.offsets[arg] + size <= kPayload;
+		};
+		auto Terminated = [&](size_t arg) -> bool
+		{
+			return entry.types[arg] == arg_string && Stored(arg, 1) && memchr(entry.payload + entry.offsets[arg], '\0', kPayload - entry.offsets[arg]) != nullptr;
+		};
+		auto Integer = [&](size_t arg) -> uint64_t
+		{
+			uint64_t raw = 0;
+			memcpy(&raw, entry.payload + entry.offsets[arg], sizeof(raw));
+			return raw;
+		};
+
+		for (const char* p = entry.format; *p; p++)
+		{
+			if (*p != '%')
+			{
+				text += *p;
+				continue;
+			}
+			if (p[1] == '%')
+			{
+				text += '%';
+				p++;
+				continue;
+			}
+
+			// %[flags][width][.precision][length]conversion, the length is replaced by the stored type
+			std::string spec = "%";
+			for (p++; *p && strchr("-+ #0", *p); p++) spec += *p;
+			for (; *p && (isdigit(static_cast<unsigned char>(*p)) || *p == '.' || *p == '*'); p++)
+			{
+				if (*p == '*')
+				{
+					const bool stored = next < entry.count && Stored(next, sizeof(uint64_t));
+					spec += std::to_string(stored ? static_cast<int>(Integer(next)) : 0);
+					next += (next < entry.count);
+				}
+				else
+				{
+					spec += *p;
+				}
+			}
+			for (; *p && strchr("hljztL", *p); p++) {}
+			if (*p == '\0')
+			{
+				break;
+			}
+
+			const char conversion = *p;
+			if (next >= entry.count)
+			{
+				text += "<?>";
+				continue;
+			}
+
+			const size_t arg = next++;
+			const uint8_t type = entry.types[arg];
+			if (conversion == 's' ? !Terminated(arg) : !Stored(arg, sizeof(uint64_t)))
+			{
+				text += "<?>";
+				continue;
+			}
+
+			if (conversion == 's')
+			{
+				snprintf(buffer, sizeof(buffer), (spec + 's').c_str(), reinterpret_cast<const char*>(entry.payload + entry.offsets[arg]));
+			}
+			else if (strchr("fFeEgGaA", conversion))
+			{
+				double value = 0;
+				memcpy(&value, entry.payload + entry.offsets[arg], sizeof(value));
+				snprintf(buffer, sizeof(buffer), (spec + conversion).c_str(), type == arg_double ? value : static_cast<double>(Integer(arg)));
+			}
+			else if (conversion == 'p')
+			{
+				snprintf(buffer, sizeof(buffer), (spec + 'p').c_str(), reinterpret_cast<void*>(static_cast<uintptr_t>(Integer(arg))));
+			}
+			else if (conversion == 'c')
+			{
+				snprintf(buffer, sizeof(buffer), (spec + 'c').c_str(), static_cast<int>(Integer(arg)));
+			}
+			else if (conversion == 'd' || conversion == 'i')
+			{
+				snprintf(buffer, sizeof(buffer), (spec + "ll" + conversion).c_str(), static_cast<long long>(Integer(arg)));
+			}
+			else
+			{
+				snprintf(buffer, sizeof(buffer), (spec + "ll" + conversion).c_str(), static_cast<unsigned long long>(Integer(arg)));
+			}
+			text += buffer;
+		}
+		return text;
+	}
+
+	// oldest first, records still being written or already overwritten are skipped
+	template<typename Sink>
+	static size_t Drain(Sink&& sink)
+	{
+		const uint64_t head = getHead().load(std::memory_order_acquire);
+		uint64_t tail = std::max(getTail().load(std::memory_order_relaxed), head > kRecords ? head - kRecords : 0);
+
+		size_t written = 0;
+		record* records = getRecords();
+		for (; tail < head; tail++)
+		{
+			record& slot = records[tail % kRecords];
+			if (slot.sequence.load(std::memory_order_acquire) != tail + 1)
+			{
+				continue;
+			}
+
+			record copy;
+			copy.time = slot.time;
+			copy.format = slot.format;
+			copy.tid = slot.tid;
+			copy.level = slot.level;
+			copy.count = slot.count;
+			memcpy(copy.types, slot.types, sizeof(copy.types));
+			memcpy(copy.offsets, slot.offsets, sizeof(copy.offsets));
+			memcpy(copy.payload, slot.payload, sizeof(copy.payload));
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.sequence.load(std::memory_order_relaxed) != tail + 1)
+			{
+				continue;
+			}
+
+			sink(copy, Format(copy));
+			written++;
+		}
+		getTail().store(head, std::memory_order_relaxed);
+		return written;
+	}
+};
+
+void set_log_level(log_level level)
+{
+	log_ring::getLevel() = static_cast<int>(level);
+}
+
+size_t flush_log(log_sink sink, const std::string& path)
+{
+	static std::mutex mutex;
+	std::lock_guard<std::mutex> lock(mutex);
+
+	FILE* fp = (sink == log_sink::file) ? fopen(path.c_str(), "a") : stderr;
+	if (fp == nullptr)
+	{
+		return 0;
+	}
+
+	size_t written = log_ring::Drain([&](const auto& entry, const std::string& text)
+	{
+#ifdef __ANDROID__
+		if (sink == log_sink::logcat)
+		{
+			static const int priorities[] = { ANDROID_LOG_INFO, ANDROID_LOG_WARN, ANDROID_LOG_ERROR };
+			__android_log_write(priorities[entry.level], PATTERNS_NAME, text.c_str());
+			return;
+		}
+#endif
+		static const char* names[] = { "I", "W", "E" };
+		fprintf(fp, "%" PRIu64 ".%06" PRIu64 " %ld %s " PATTERNS_NAME ": %s\n", 
+			static_cast<uint64_t>(entry.time / 1000000), static_cast<uint64_t>(entry.time % 1000000), entry.tid, names[entry.level], text.c_str());
+	});
+
+	if (fp != stderr)
+	{
+		fclose(fp);
+	}
+	return written;
+}
+}
+
+#define PATTERNS_LOGI(text) hook::log_ring::Write(hook::log_level::info, text)
+#define PATTERNS_LOGE(text) hook::log_ring::Write(hook::log_level::error, text)
+#define PATTERNS_LOGW(text) hook::log_ring::Write(hook::log_level::warn, text)
+#define PATTERNS_LOGIS(text, ...) hook::log_ring::Write(hook::log_level::info, text, __VA_ARGS__)
+#define PATTERNS_LOGES(text, ...) hook::log_ring::Write(hook::log_level::error, text, __VA_ARGS__)
+#define PATTERNS_LOGWS(text, ...) hook::log_ring::Write(hook::log_level::warn, text, __VA_ARGS__)
 #else
 #define PATTERNS_LOGE(text) ((void)0)
 #define PATTERNS_LOGES(...) ((void)0)
@@ -81,18 +452,30 @@ dladdr(reinterpret_cast<void*>(addr), &vname)
 #define PATTERNS_LOGWS(...) ((void)0)
 #endif
 
+// per-pattern counters, nothing is left in the scan loops when disabled
+#if PATTERNS_USE_STATS
+#define PATTERNS_STATS(expr) expr
+#else
+#define PATTERNS_STATS(expr)
+#endif
+
 #ifndef __LP64__
 typedef Elf32_Ehdr Elf_ehdr;
-typedef elf32_phdr elf_phdr;
-typedef elf32_shdr elf_shdr;
+typedef Elf32_Phdr elf_phdr;
+typedef Elf32_Shdr elf_shdr;
+typedef Elf32_Sym elf_sym;
 #define PATTERNS_ADDR_FMT "0x%" PRIx32
 #else
 typedef Elf64_Ehdr Elf_ehdr;
-typedef elf64_phdr elf_phdr;
-typedef elf64_shdr elf_shdr;
+typedef Elf64_Phdr elf_phdr;
+typedef Elf64_Shdr elf_shdr;
+typedef Elf64_Sym elf_sym;
 #define PATTERNS_ADDR_FMT "0x%" PRIx64 // warning
 #endif // 
 
+#ifndef PT_ARM_EXIDX
+#define PT_ARM_EXIDX 0x70000001
+#endif
 
 #if PATTERNS_USE_HINTS
 
@@ -204,7 +587,7 @@ namespace hook
 				{
 					std::string library_name = buffer.substr(buffer.find_last_of('/') + 1);
 
-					if (PATTERNS_DL_OPEN(library_name.c_str(), RTLD_NOLOAD)) // check library is loaded
+					if (PATTERNS_DL_OPEN(library_name.c_str(), RTLD_NOLOAD | RTLD_LAZY)) // check library is loaded
 					{
 						if (std::find(librarys.begin(), librarys.end(), library_name) == librarys.end())
 						{
@@ -229,7 +612,33 @@ static auto& getHints()
 }
 #endif
 
-static void TransformPattern(std::string_view pattern, std::basic_string<uint8_t>& data, std::basic_string<uint8_t>& mask)
+#if PATTERNS_USE_HINTS && PATTERNS_CAN_SERIALIZE_HINTS
+// hints of an earlier run: lib_name : offset, rebased onto the current load address when a pattern looks them up
+static auto& getModuleHints()
+{
+	static std::multimap<uint64_t, std::pair<std::string, uintptr_t>> hints;
+	return hints;
+}
+
+// 0 if the module is not loaded
+static uintptr_t RebaseHint(const std::pair<std::string, uintptr_t>& hint)
+{
+	const uintptr_t base = static_cast<uintptr_t>(details::get_process_base(hint.first));
+	return (base != 0) ? base + hint.second : 0;
+}
+#endif
+
+// IDA format: "48 8B ? ? 05", plus
+// "9?": high nibble only, "94&FC": bit mask for the previous byte, "b:100101??": one byte per 8 bits ('?' = any bit, most significant first),
+// "[2-16]": 2 to 16 bytes of anything, "[4]": exactly 4 (decimal, gaps is null: patterns with gaps are rejected,
+//   the variable widths (max - min) of all gaps may add up to maxGapWidth),
+// "(48|4C)", "(40-47|4C)": one byte out of a class (classes is null: patterns with classes are rejected),
+// "<name:i32>", "[name:adrp]": a named field read on every match (captures is null: patterns with captures are rejected)
+static const size_t maxGapWidth = 0x1000;
+
+static void TransformPattern(std::string_view pattern, std::basic_string<uint8_t>& data, std::basic_string<uint8_t>& mask,
+	std::vector<details::pattern_gap>* gaps = nullptr, std::vector<details::pattern_class>* classes = nullptr,
+	std::vector<pattern_capture>* captures = nullptr)
 {
 	uint8_t tempDigit = 0;
 	bool tempFlag = false;
@@ -241,716 +650,4850 @@ static void TransformPattern(std::string_view pattern, std::basic_string<uint8_t
 		return uint8_t(ch - '0');
 	};
 
-	for (auto ch : pattern)
+	auto isHex = [] (char ch) -> bool
+	{
+		return (ch >= '0' && ch <= '9') || (ch >= 'A' && ch <= 'F') || (ch >= 'a' && ch <= 'f');
+	};
+
+	for (size_t i = 0; i < pattern.size(); i++)
 	{
+		char ch = pattern[i];
 		if (ch == ' ')
 		{
 			continue;
 		}
 		else if (ch == '?')
 		{
-			data.push_back(0);
-			mask.push_back(0);
+			if (tempFlag)
+			{
+				// "9?"
+				data.push_back(tempDigit);
+				mask.push_back(0xF0);
+				tempFlag = false;
+			}
+			else
+			{
+				data.push_back(0);
+				mask.push_back(0);
+			}
+		}
+		else if (ch == '&' && !tempFlag && !mask.empty() && i + 2 < pattern.size() && isHex(pattern[i + 1]) && isHex(pattern[i + 2]))
+		{
+			// "94&FC"
+			mask.back() &= uint8_t((tol(pattern[i + 1]) << 4) | tol(pattern[i + 2]));
+			data.back() &= mask.back();
+			i += 2;
 		}
-		else if ((ch >= '0' && ch <= '9') || (ch >= 'A' && ch <= 'F') || (ch >= 'a' && ch <= 'f'))
+		else if (ch == 'b' && !tempFlag && i + 1 < pattern.size() && pattern[i + 1] == ':')
 		{
-			uint8_t thisDigit = tol(ch);
-
-			if (!tempFlag)
+			// "b:10010100"
+			uint8_t value = 0, bits = 0;
+			int count = 0;
+			for (i += 2; i < pattern.size() && (pattern[i] == '0' || pattern[i] == '1' || pattern[i] == '?'); i++)
 			{
-				tempDigit = thisDigit << 4;
-				tempFlag = true;
+				value = uint8_t((value << 1) | (pattern[i] == '1'));
+				bits = uint8_t((bits << 1) | (pattern[i] != '?'));
+				if (++count == 8)
+				{
+					data.push_back(value);
+					mask.push_back(bits);
+					value = bits = 0;
+					count = 0;
+				}
 			}
-			else
+			if (count != 0)
 			{
-				tempDigit |= thisDigit;
-				tempFlag = false;
-
-				data.push_back(tempDigit);
-				mask.push_back(0xFF);
+				PATTERNS_LOGWS("TransformPattern: incomplete binary byte ignored: %s", std::string(pattern).c_str());
 			}
+			i--;
 		}
-	}
-}
-
-class executable_meta
-{
-private:
-	// key: elf head, value: file size
-	std::map<Elf_ehdr*, off_t> m_elf;
-	
-	// file section
-	// key: lib_name : section_name, value: begin : end
-	// All readable sections form file
-	std::map<std::pair<const std::string, const std::string>, std::pair<uintptr_t, uintptr_t>> m_sections;
-	// executable setion form file, only name is .text .plt .init .init_array .fini .fini_array etc
-	std::map<std::pair<const std::string, const std::string>, std::pair<uintptr_t, uintptr_t>> m_executable_sections;
+		else if ((ch == '<' || (ch == '[' && pattern.substr(i, pattern.find(']', i) - i).find(':') != std::string_view::npos)) && !tempFlag)
+		{
+			// "<call:rel32>", "[addr:adrp]"
+			static const struct
+			{
+				std::string_view name;
+				capture_type type;
+				uint8_t size;
+				uint8_t opcode; // the top byte of arm64 instructions, under opcodeMask
+				uint8_t opcodeMask;
+			} types[] =
+			{
+				{ "i8", capture_type::i8, 1 }, { "u8", capture_type::u8, 1 },
+				{ "i16", capture_type::i16, 2 }, { "u16", capture_type::u16, 2 },
+				{ "i32", capture_type::i32, 4 }, { "u32", capture_type::u32, 4 },
+				{ "i64", capture_type::i64, 8 }, { "u64", capture_type::u64, 8 },
+				{ "rel8", capture_type::rel8, 1 }, { "rel32", capture_type::rel32, 4 },
+				{ "bl", capture_type::bl, 4, 0x14, 0x7C }, { "adrp", capture_type::adrp, 4, 0x90, 0x9F },
+			};
 
-	// memory segment
-	// key: lib_name : id, value: begin : end
-	// All readable segments form memory
-	std::map<std::pair<const std::string, uint16_t>, std::pair<uintptr_t, uintptr_t>> m_segments;
-	// executable segment form memory, only type is PF_R or PF_X and flags is PT_LOAD
-	std::map<std::pair<const std::string, uint16_t>, std::pair<uintptr_t, uintptr_t>> m_executable_segments;
-	
-	// library name (path) or process_name
-	std::string m_name;
+			size_t close = pattern.find(ch == '<' ? '>' : ']', i);
+			size_t colon = pattern.find(':', i);
+			std::string_view name, type;
+			if (close != std::string_view::npos && colon < close)
+			{
+				name = pattern.substr(i + 1, colon - i - 1);
+				type = pattern.substr(colon + 1, close - colon - 1);
+			}
+			auto entry = std::find_if(std::begin(types), std::end(types), [&](const auto& candidate) { return candidate.name == type; });
+			bool valid = !name.empty() && entry != std::end(types) &&
+				std::all_of(name.begin(), name.end(), [](char c) { return isalnum(static_cast<unsigned char>(c)) || c == '_'; });
 
-	void FindLibrarys()
-	{
-		m_name = (m_name.empty() ? details::get_process_name() : m_name);
+			// captures sit at a fixed distance from the start of the match
+			size_t offset = data.size();
+			for (size_t j = 0; valid && gaps != nullptr && j < gaps->size(); j++)
+			{
+				valid = ((*gaps)[j].min == (*gaps)[j].max);
+				offset += (*gaps)[j].min;
+			}
+			if (!valid || (captures != nullptr && std::any_of(captures->begin(), captures->end(), [&](const pattern_capture& other) { return other.name == name; })))
+			{
+				PATTERNS_LOGES("TransformPattern: bad capture: %s", std::string(pattern).c_str());
+				data.clear();
+				mask.clear();
+				return;
+			}
+			if (captures == nullptr)
+			{
+				PATTERNS_LOGES("TransformPattern: captures are not supported here: %s", std::string(pattern).c_str());
+				data.clear();
+				mask.clear();
+				return;
+			}
 
-		PATTERNS_DL_ITERATE_PHDR([](struct dl_phdr_info* info, size_t size, void* data) -> int
+			captures->push_back({ std::string(name), offset, entry->type });
+			data.append(entry->size, 0);
+			mask.append(entry->size, 0);
+			data.back() = entry->opcode;
+			mask.back() = entry->opcodeMask;
+			i = close;
+		}
+		else if (ch == '[' && !tempFlag)
+		{
+			// "[2-16]", "[4]"
+			size_t close = pattern.find(']', i);
+			size_t min = 0, max = 0, digits = 0;
+			bool range = false, valid = (close != std::string_view::npos);
+			for (size_t j = i + 1; valid && j < close; j++)
 			{
-				executable_meta* self = reinterpret_cast<executable_meta*>(data);
-				if (self->m_name.empty())
+				if (pattern[j] >= '0' && pattern[j] <= '9')
 				{
-					return 1; // exit
+					size_t& bound = range ? max : min;
+					bound = bound * 10 + (pattern[j] - '0');
+					valid = (++digits <= 4);
 				}
-
-				auto ExplainElfSection = [=]() -> bool
+				else if (pattern[j] == '-' && !range && digits != 0)
 				{
-					bool result = false;
-
-					int fd = open(info->dlpi_name, O_RDONLY | O_CLOEXEC);
-					if (fd == -1)
-					{
-						PATTERNS_LOGES("Explain elf file: open file failed: %s", info->dlpi_name);
-						return result;
-					}
-					off_t fsize = lseek(fd, 0, SEEK_END);
-					if (fsize <= 0)
-					{
-						PATTERNS_LOGES("Explain elf file: get file size failed: %s", info->dlpi_name);
-						close(fd);
-						return result;
-					}
-					void* fdata = mmap(nullptr, fsize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
-					close(fd);
-					if (fdata == MAP_FAILED)
-					{
-						PATTERNS_LOGES("Explain elf file: mmap failed: %d - %s", errno, strerror(errno));
-						return result;
-					}
-					Elf_ehdr* ehdr = reinterpret_cast<Elf_ehdr*>(fdata);
-					if (ehdr->e_ident[EI_MAG0] != 0x7F || ehdr->e_ident[EI_MAG1] != 'E' || ehdr->e_ident[EI_MAG2] != 'L' || ehdr->e_ident[EI_MAG3] != 'F')
-					{
-						PATTERNS_LOGES("Explain elf file: this is not an ELF file: %s", info->dlpi_name);
-						munmap(fdata, fsize);
-						return result;
-					}
-
-					elf_shdr* shdr = reinterpret_cast<elf_shdr*>(((uintptr_t)ehdr) + ehdr->e_shoff);
-					uintptr_t shdr_addr = (uintptr_t)shdr;
-					char* shstrtab = reinterpret_cast<char*>((uintptr_t)ehdr + shdr[ehdr->e_shstrndx].sh_offset);
-
-					for (int i = 0; i < ehdr->e_shnum; i++, shdr_addr += ehdr->e_shentsize)
-					{
-						elf_shdr* sec_info = reinterpret_cast<elf_shdr*>(shdr_addr);
-
-						std::string name = shstrtab + sec_info->sh_name;
-						if (sec_info->sh_type == SHT_PROGBITS && sec_info->sh_flags == (SHF_ALLOC | SHF_EXECINSTR))
-						{
-							self->m_executable_sections.emplace(std::make_pair(info->dlpi_name, name), 
-								std::make_pair(info->dlpi_addr + sec_info->sh_addr, info->dlpi_addr + sec_info->sh_addr + sec_info->sh_size));
-							PATTERNS_LOGIS("Explain elf file: executable section: process_name: %s, lib_name: %s, lib_base: " PATTERNS_ADDR_FMT "", self->m_name.c_str(), info->dlpi_name, (uintptr_t)info->dlpi_addr);
-							PATTERNS_LOGIS("section info: section_name: %s, section_start: " PATTERNS_ADDR_FMT ", section_end: " PATTERNS_ADDR_FMT "", name.c_str(), (uintptr_t)(info->dlpi_addr + sec_info->sh_addr), (uintptr_t)(info->dlpi_addr + sec_info->sh_addr + sec_info->sh_size));
-						}
-						if (sec_info->sh_addr == 0 && name.empty()) // .elf_head
-						{
-							name = ".elf_head";
-							sec_info->sh_size = ehdr->e_ehsize;
-						}
-						self->m_sections.emplace(std::make_pair(info->dlpi_name, name), 
-							std::make_pair(info->dlpi_addr + sec_info->sh_addr, info->dlpi_addr + sec_info->sh_addr + sec_info->sh_size));
-						PATTERNS_LOGIS("Explain elf file: section: process_name: %s, lib_name: %s, lib_base: " PATTERNS_ADDR_FMT "", self->m_name.c_str(), info->dlpi_name, (uintptr_t)info->dlpi_addr);
-						PATTERNS_LOGIS("section info: section_name: %s, section_start: " PATTERNS_ADDR_FMT ", section_end: " PATTERNS_ADDR_FMT "", name.c_str(), (uintptr_t)(info->dlpi_addr + sec_info->sh_addr), (uintptr_t)(info->dlpi_addr + sec_info->sh_addr + sec_info->sh_size));
-					}
-
-					self->m_elf.emplace(ehdr, fsize);
-					return true;
-				};
-
-				static const std::string process_name = details::get_process_name();
-				if (self->m_name == process_name) // = process name
+					range = true;
+					digits = 0;
+				}
+				else if (pattern[j] != ' ')
 				{
-					// lib_name: xxx.so 
-					// info->dlpi_name: /.../.../xxx.so
-					static std::vector<std::string> section_lib_name = get_process_librarys();
-					static std::vector<std::string> segment_lib_name = section_lib_name;
-					if (section_lib_name.empty() || segment_lib_name.empty())
-					{
-						return 1; // exit
-					}
-
-					for (auto i = section_lib_name.begin(); i != section_lib_name.end();)
-					{
-						if (strstr(info->dlpi_name, i->c_str()) && strstr(info->dlpi_name, process_name.c_str()))
-						{
-							if (ExplainElfSection())
-							{
-								i = section_lib_name.erase(i);
-								continue; // next
-							}
-							PATTERNS_LOGWS("Explain Elf files failed: %s", info->dlpi_name);
-						}
-						++i; // next
-					}
+					valid = false;
+				}
+			}
+			if (!range)
+			{
+				max = min;
+			}
+			if (!valid || digits == 0 || min > max)
+			{
+				PATTERNS_LOGES("TransformPattern: bad gap: %s", std::string(pattern).c_str());
+				data.clear();
+				mask.clear();
+				return;
+			}
+			if (gaps == nullptr)
+			{
+				PATTERNS_LOGES("TransformPattern: gaps are not supported here: %s", std::string(pattern).c_str());
+				data.clear();
+				mask.clear();
+				return;
+			}
 
-					for (auto l = segment_lib_name.begin(); l != segment_lib_name.end();)
-					{
-						if (strstr(info->dlpi_name, l->c_str()) && strstr(info->dlpi_name, process_name.c_str()))
-						{
-							if (info->dlpi_phdr != nullptr)
-							{
-								for (int j = 0; j < info->dlpi_phnum; j++)
-								{
-									if (info->dlpi_phdr[j].p_type == PT_LOAD && info->dlpi_phdr[j].p_flags == (PF_R | PF_X))
-									{
-										self->m_executable_segments.emplace(std::make_pair(info->dlpi_name, j), 
-											std::make_pair(info->dlpi_addr + info->dlpi_phdr[j].p_vaddr, info->dlpi_addr + info->dlpi_phdr[j].p_vaddr + info->dlpi_phdr[j].p_memsz));
-										PATTERNS_LOGIS("Explain elf file: executable segment: process_name: %s, lib_name: %s, lib_base: " PATTERNS_ADDR_FMT "", 
-											self->m_name.c_str(), info->dlpi_name, (uintptr_t)info->dlpi_addr);
-										PATTERNS_LOGIS("segment info: id: %d, segment_start: " PATTERNS_ADDR_FMT ", segment_end: " PATTERNS_ADDR_FMT "", 
-											j, (uintptr_t)(info->dlpi_addr + info->dlpi_phdr[j].p_vaddr), (uintptr_t)(info->dlpi_addr + info->dlpi_phdr[j].p_vaddr + info->dlpi_phdr[j].p_memsz));
-									}
-									self->m_segments.emplace(std::make_pair(info->dlpi_name, j), 
-										std::make_pair(info->dlpi_addr + info->dlpi_phdr[j].p_vaddr, info->dlpi_addr + info->dlpi_phdr[j].p_vaddr + info->dlpi_phdr[j].p_memsz));
-									PATTERNS_LOGIS("Explain elf file: segment: process_name: %s, lib_name: %s, lib_base: " PATTERNS_ADDR_FMT "", 
-										self->m_name.c_str(), info->dlpi_name, (uintptr_t)info->dlpi_addr);
-									PATTERNS_LOGIS("segment info: id: %d, segment_start: " PATTERNS_ADDR_FMT ", segment_end: " PATTERNS_ADDR_FMT "", 
-										j, (uintptr_t)(info->dlpi_addr + info->dlpi_phdr[j].p_vaddr), (uintptr_t)(info->dlpi_addr + info->dlpi_phdr[j].p_vaddr + info->dlpi_phdr[j].p_memsz));
-								}
-								l = segment_lib_name.erase(l);
-								continue; // next
-							}
-						}
-						++l; // next
-					}
+			// a leading gap adds nothing, consecutive gaps add up
+			if (!data.empty())
+			{
+				if (!gaps->empty() && gaps->back().position == data.size())
+				{
+					gaps->back().min += min;
+					gaps->back().max += max;
+				}
+				else
+				{
+					gaps->push_back({ data.size(), min, max });
+				}
+			}
+			i = close;
+		}
+		else if (ch == '(' && !tempFlag)
+		{
+			// "(48|4C)", "(40-4F|50)"
+			size_t close = pattern.find(')', i);
+			details::pattern_class byteClass{};
+			bool valid = (close != std::string_view::npos);
+			for (size_t j = i + 1; valid && j < close;)
+			{
+				if (pattern[j] == ' ' || pattern[j] == '|')
+				{
+					j++;
+					continue;
+				}
+				if (j + 1 >= close || !isHex(pattern[j]) || !isHex(pattern[j + 1]))
+				{
+					valid = false;
+					break;
 				}
-				else // = library name(path)
+				int first = (tol(pattern[j]) << 4) | tol(pattern[j + 1]), last = first;
+				j += 2;
+				if (j < close && pattern[j] == '-')
 				{
-					if (strstr(info->dlpi_name, self->m_name.c_str()))
+					if (j + 2 >= close || !isHex(pattern[j + 1]) || !isHex(pattern[j + 2]))
 					{
-						if (ExplainElfSection() || info->dlpi_phdr != nullptr)
-						{
-							for (int j = 0; j < info->dlpi_phnum; j++)
-							{
-								if (info->dlpi_phdr[j].p_type == PT_LOAD && info->dlpi_phdr[j].p_flags == (PF_R | PF_X))
-								{
-									self->m_executable_segments.emplace(std::make_pair(info->dlpi_name, j), 
-										std::make_pair(info->dlpi_addr + info->dlpi_phdr[j].p_vaddr, info->dlpi_addr + info->dlpi_phdr[j].p_vaddr + info->dlpi_phdr[j].p_memsz));
-									PATTERNS_LOGIS("Explain elf file: executable segment: process_name: %s, lib_name: %s, lib_base: " PATTERNS_ADDR_FMT "", 
-										self->m_name.c_str(), info->dlpi_name, (uintptr_t)info->dlpi_addr);
-									PATTERNS_LOGIS("segment info: id: %d, segment_start: " PATTERNS_ADDR_FMT ", segment_end: " PATTERNS_ADDR_FMT "", 
-										j, (uintptr_t)(info->dlpi_addr + info->dlpi_phdr[j].p_vaddr), (uintptr_t)(info->dlpi_addr + info->dlpi_phdr[j].p_vaddr + info->dlpi_phdr[j].p_memsz));
-								}
-								self->m_segments.emplace(std::make_pair(info->dlpi_name, j), 
-									std::make_pair(info->dlpi_addr + info->dlpi_phdr[j].p_vaddr, info->dlpi_addr + info->dlpi_phdr[j].p_vaddr + info->dlpi_phdr[j].p_memsz));
-								PATTERNS_LOGIS("Explain elf file: segment: process_name: %s, lib_name: %s, lib_base: " PATTERNS_ADDR_FMT "", 
-									self->m_name.c_str(), info->dlpi_name, (uintptr_t)info->dlpi_addr);
-								PATTERNS_LOGIS("segment info: id: %d, segment_start: " PATTERNS_ADDR_FMT ", segment_end: " PATTERNS_ADDR_FMT "", 
-									j, (uintptr_t)(info->dlpi_addr + info->dlpi_phdr[j].p_vaddr), (uintptr_t)(info->dlpi_addr + info->dlpi_phdr[j].p_vaddr + info->dlpi_phdr[j].p_memsz));
-							}
-							return 1; // exit
-						}
-						PATTERNS_LOGWS("Explain Elf files failed: %s", info->dlpi_name);
+						valid = false;
+						break;
 					}
+					last = (tol(pattern[j + 1]) << 4) | tol(pattern[j + 2]);
+					j += 3;
 				}
-				return 0;
-			}, this);
-	}
-
-	explicit executable_meta(const std::string& lib_name)
-		: m_name(lib_name.empty() ? m_name : lib_name)
-	{
-	}
+				if (first > last || (j < close && pattern[j] != ' ' && pattern[j] != '|'))
+				{
+					valid = false;
+					break;
+				}
+				for (int value = first; value <= last; value++)
+				{
+					byteClass.bits[value >> 6] |= uint64_t(1) << (value & 63);
+				}
+			}
 
-public:
-	void Initialize(uintptr_t begin)
-	{
-		if (m_name.empty())
-		{
-			PATTERNS_DL_ADDR(begin, info);
-			if (info.dli_fbase == nullptr)
+			// the bits every member shares go to data / mask, the table is only kept when it says more
+			int members = 0, reference = -1;
+			uint8_t agree = 0xFF;
+			for (int value = 0; valid && value < 256; value++)
 			{
-				return;
+				if (byteClass.test(static_cast<uint8_t>(value)))
+				{
+					reference = (reference < 0) ? value : reference;
+					agree &= ~(value ^ reference);
+					members++;
+				}
 			}
-			if (info.dli_fname != nullptr)
+			if (!valid || members == 0)
 			{
-				m_name = info.dli_fname;
+				PATTERNS_LOGES("TransformPattern: bad byte class: %s", std::string(pattern).c_str());
+				data.clear();
+				mask.clear();
+				return;
 			}
-			PATTERNS_DL_ADDR_CLEAN;
-		}
-		
-		FindLibrarys();
 
-		if (!m_sections.empty())
-		{
-			for (auto& section : m_sections)
+			data.push_back(uint8_t(reference & agree));
+			mask.push_back(agree);
+			if (members != (256 >> __builtin_popcount(agree)))
 			{
-				if (section.second.first <= begin && begin < section.second.second)
+				if (classes == nullptr)
 				{
-					uintptr_t end = section.second.second;
-					std::pair<const std::string, const std::string> name = section.first;
-					m_sections.clear();
-					m_sections.emplace(name, std::make_pair(begin, end));
-					m_executable_sections.clear();
-					m_executable_sections.emplace(name, std::make_pair(begin, end));
-
-					PATTERNS_LOGIS("executable_meta::Initialize: lib_name: %s, section_name: %s, begin: " PATTERNS_ADDR_FMT ", end: " PATTERNS_ADDR_FMT "", 
-						name.first.c_str(), name.second.c_str(), begin, end);
-					break;
+					PATTERNS_LOGES("TransformPattern: byte classes are not supported here: %s", std::string(pattern).c_str());
+					data.clear();
+					mask.clear();
+					return;
 				}
+				byteClass.position = data.size() - 1;
+				classes->push_back(byteClass);
 			}
+			i = close;
 		}
-		if (!m_segments.empty())
+		else if (isHex(ch))
 		{
-			for (auto& segment : m_segments)
+			uint8_t thisDigit = tol(ch);
+
+			if (!tempFlag)
 			{
-				if (segment.second.first <= begin && begin < segment.second.second)
-				{
-					uintptr_t end = segment.second.second;
-					std::pair<const std::string, uint16_t> name = segment.first;
-					m_segments.clear();
-					m_segments.emplace(name, std::make_pair(begin, end));
-					m_executable_segments.clear();
-					m_executable_segments.emplace(name, std::make_pair(begin, end));
+				tempDigit = thisDigit << 4;
+				tempFlag = true;
+			}
+			else
+			{
+				tempDigit |= thisDigit;
+				tempFlag = false;
 
-					PATTERNS_LOGIS("executable_meta::Initialize: lib_name: %s, segment_id: %d, begin: " PATTERNS_ADDR_FMT ", end: " PATTERNS_ADDR_FMT "", 
-						name.first.c_str(), name.second, begin, end);
-					break;
-				}
+				data.push_back(tempDigit);
+				mask.push_back(0xFF);
 			}
 		}
 	}
 
-	void Initialize(uintptr_t begin, uintptr_t end)
+	// a trailing gap adds nothing
+	if (gaps != nullptr && !gaps->empty() && gaps->back().position == data.size())
 	{
-		PATTERNS_LOGIS("executable_meta::Initialize: name: %s, begin: " PATTERNS_ADDR_FMT ", end: " PATTERNS_ADDR_FMT "", m_name.c_str(), begin, end);
-		
-		if (begin >= end && begin != 0u && end != 0u)
+		gaps->pop_back();
+	}
+
+	// every anchor hit is verified over the placements the widths allow
+	size_t width = 0;
+	for (size_t i = 0; gaps != nullptr && i < gaps->size(); i++)
+	{
+		width += (*gaps)[i].max - (*gaps)[i].min;
+	}
+	if (width > maxGapWidth)
+	{
+		PATTERNS_LOGES("TransformPattern: gaps too wide: %s", std::string(pattern).c_str());
+		data.clear();
+		mask.clear();
+	}
+}
+
+#if PATTERNS_USE_TRACE
+// Chrome trace (chrome://tracing, ui.perfetto.dev) of the scan phases,
+// every thread appends complete events to its own ring buffer without locks, the oldest are overwritten
+class tracer
+{
+public:
+	struct event
+	{
+		const char* name;
+		uint64_t pattern;
+		uint64_t begin;
+		uint64_t end;
+		uintptr_t rangeBegin;
+		uintptr_t rangeEnd;
+	};
+
+	// pattern of the spans opened on this thread
+	static inline thread_local uint64_t currentPattern = 0;
+
+private:
+	struct thread_buffer
+	{
+		std::vector<event> events;
+		std::atomic<size_t> head{ 0 };
+		long tid = 0;
+		uint64_t generation = 0;
+	};
+
+	static auto& getBuffers()
+	{
+		static std::vector<std::shared_ptr<thread_buffer>> buffers;
+		return buffers;
+	}
+
+	static auto& getPatterns()
+	{
+		static std::map<uint64_t, std::string> patterns;
+		return patterns;
+	}
+
+	static std::mutex& getMutex()
+	{
+		static std::mutex mutex;
+		return mutex;
+	}
+
+	// events per thread, 0: not tracing
+	static std::atomic<size_t>& getCapacity()
+	{
+		static std::atomic<size_t> capacity{ 0 };
+		return capacity;
+	}
+
+	static std::atomic<uint64_t>& getGeneration()
+	{
+		static std::atomic<uint64_t> generation{ 0 };
+		return generation;
+	}
+
+	// registered once per thread and trace, the buffer outlives the thread
+	static thread_buffer* GetThreadBuffer()
+	{
+		static thread_local std::shared_ptr<thread_buffer> buffer;
+
+		const uint64_t generation = getGeneration().load(std::memory_order_acquire);
+		if (!buffer || buffer->generation != generation)
 		{
-			PATTERNS_LOGE("executable_meta::Initialize: begin >= end");
-			return;
+			auto created = std::make_shared<thread_buffer>();
+			created->events.resize(std::max<size_t>(getCapacity().load(std::memory_order_relaxed), 1));
+			created->tid = syscall(__NR_gettid);
+			created->generation = generation;
+
+			std::lock_guard<std::mutex> lock(getMutex());
+			getBuffers().emplace_back(created);
+			buffer = std::move(created);
 		}
-		if (begin == 0u && end == 0u)
+		return buffer.get();
+	}
+
+public:
+	static inline bool Enabled()
+	{
+		return getCapacity().load(std::memory_order_relaxed) != 0;
+	}
+
+	static inline uint64_t Now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static void Start(size_t capacity)
+	{
+		std::lock_guard<std::mutex> lock(getMutex());
+		getBuffers().clear();
+		getPatterns().clear();
+		getCapacity() = capacity;
+		getGeneration()++;
+	}
+
+	static void Stop()
+	{
+		getCapacity() = 0;
+	}
+
+	static void Record(const event& info)
+	{
+		thread_buffer* buffer = GetThreadBuffer();
+		const size_t head = buffer->head.load(std::memory_order_relaxed);
+		buffer->events[head % buffer->events.size()] = info;
+		buffer->head.store(head + 1, std::memory_order_release);
+	}
+
+	static uint64_t RegisterPattern(std::string_view text)
+	{
+		static std::atomic<uint64_t> next{ 0 };
+		const uint64_t id = ++next;
+		if (Enabled())
 		{
-			PATTERNS_LOGW("executable_meta::Initialize: begin and end is 0. find all segments or sections in the process by default.");
-			FindLibrarys();
-			return;
+			std::lock_guard<std::mutex> lock(getMutex());
+			getPatterns().emplace(id, text);
 		}
-		if (end == 0u)
+		return id;
+	}
+
+	// exact after stop_trace(), a thread which is still tracing may overwrite what is being written
+	static bool Write(const std::string& path)
+	{
+		std::ofstream out(path, std::ios::trunc);
+		if (!out)
 		{
-			Initialize(begin);
-			return;
+			PATTERNS_LOGES("tracer: open %s failed", path.c_str());
+			return false;
 		}
-		if (begin == 0)
+
+		auto escape = [](const std::string& text)
 		{
-			if (m_name.empty())
+			std::string result;
+			for (char ch : text)
 			{
-				PATTERNS_DL_ADDR(end, info);
-				if (info.dli_fbase == nullptr)
+				if (ch == '"' || ch == '\\') result += '\\';
+				result += ch;
+			}
+			return result;
+		};
+
+		std::lock_guard<std::mutex> lock(getMutex());
+		const long pid = getpid();
+		bool first = true;
+
+		out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+		out << std::fixed << std::setprecision(3);
+		for (auto& buffer : getBuffers())
+		{
+			const size_t head = buffer->head.load(std::memory_order_acquire);
+			const size_t count = std::min(head, buffer->events.size());
+
+			out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << buffer->tid 
+				<< ",\"args\":{\"name\":\"patterns " << buffer->tid << "\"}}";
+			first = false;
+
+			for (size_t i = head - count; i < head; i++)
+			{
+				const event& info = buffer->events[i % buffer->events.size()];
+				out << ",\n{\"name\":\"" << info.name << "\",\"cat\":\"patterns\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << buffer->tid
+					<< ",\"ts\":" << info.begin / 1e3 << ",\"dur\":" << (info.end - info.begin) / 1e3 << ",\"args\":{\"pattern\":" << info.pattern;
+
+				auto text = getPatterns().find(info.pattern);
+				if (text != getPatterns().end())
 				{
-					return;
+					out << ",\"signature\":\"" << escape(text->second) << "\"";
 				}
-				if (info.dli_fname != nullptr)
+				if (info.rangeBegin != 0 || info.rangeEnd != 0)
 				{
-					m_name = info.dli_fname;
+					out << ",\"begin\":\"0x" << std::hex << info.rangeBegin << "\",\"end\":\"0x" << info.rangeEnd << "\"" << std::dec;
 				}
-				PATTERNS_DL_ADDR_CLEAN;
+				out << "}}";
 			}
-			
-			FindLibrarys();
+		}
+		out << "\n]}\n";
+		return static_cast<bool>(out);
+	}
+};
 
-			if (!m_sections.empty())
-			{
-				for (auto& section : m_sections)
-				{
-					if (section.second.first < end && end <= section.second.second)
-					{
-						begin = section.second.first;
-						std::pair<const std::string, const std::string> name = section.first;
-						m_sections.clear();
-						m_sections.emplace(name, std::make_pair(begin, end));
-						m_executable_sections.clear();
-						m_executable_sections.emplace(name, std::make_pair(begin, end));
+// one complete event from construction to destruction
+class trace_span
+{
+private:
+	tracer::event m_event;
+	bool m_enabled;
 
-						PATTERNS_LOGIS("executable_meta::Initialize: lib_name: %s, section_name: %s, begin: " PATTERNS_ADDR_FMT ", end: " PATTERNS_ADDR_FMT "", 
-							name.first.c_str(), name.second.c_str(), begin, end);
-						break;
-					}
-				}
-			}
-			if (!m_segments.empty())
-			{
-				for (auto& segment : m_segments)
-				{
-					if (segment.second.first < end && end <= segment.second.second)
-					{
-						begin = segment.second.first;
-						std::pair<const std::string, uint16_t> name = segment.first;
-						m_segments.clear();
-						m_segments.emplace(name, std::make_pair(begin, end));
-						m_executable_segments.clear();
-						m_executable_segments.emplace(name, std::make_pair(begin, end));
+public:
+	explicit trace_span(const char* name, uintptr_t begin = 0, uintptr_t end = 0)
+		: m_enabled(tracer::Enabled())
+	{
+		if (m_enabled)
+		{
+			m_event = { name, tracer::currentPattern, tracer::Now(), 0, begin, end };
+		}
+	}
+
+	~trace_span()
+	{
+		Finish();
+	}
+
+	// record now instead of at destruction
+	void Finish()
+	{
+		if (m_enabled)
+		{
+			m_event.end = tracer::Now();
+			tracer::Record(m_event);
+			m_enabled = false;
+		}
+	}
+};
+
+// spans opened on this thread belong to pattern id
+class trace_pattern_scope
+{
+private:
+	uint64_t m_previous;
+
+public:
+	explicit trace_pattern_scope(uint64_t id)
+		: m_previous(tracer::currentPattern)
+	{
+		tracer::currentPattern = id;
+	}
+
+	~trace_pattern_scope()
+	{
+		tracer::currentPattern = m_previous;
+	}
+};
+
+void start_trace(size_t events_per_thread)
+{
+	tracer::Start(events_per_thread);
+}
+
+void stop_trace()
+{
+	tracer::Stop();
+}
+
+bool write_trace(const std::string& path)
+{
+	return tracer::Write(path);
+}
+
+#define PATTERNS_TRACE_CONCAT_(a, b) a##b
+#define PATTERNS_TRACE_CONCAT(a, b) PATTERNS_TRACE_CONCAT_(a, b)
+#define PATTERNS_TRACE(...) trace_span PATTERNS_TRACE_CONCAT(patternsSpan, __LINE__)(__VA_ARGS__)
+#define PATTERNS_TRACE_BEGIN(var, ...) trace_span var(__VA_ARGS__)
+#define PATTERNS_TRACE_END(var) var.Finish()
+#define PATTERNS_TRACE_PATTERN(id) trace_pattern_scope PATTERNS_TRACE_CONCAT(patternsScope, __LINE__)(id)
+#else
+#define PATTERNS_TRACE(...)
+#define PATTERNS_TRACE_BEGIN(var, ...)
+#define PATTERNS_TRACE_END(var) ((void)0)
+#define PATTERNS_TRACE_PATTERN(id)
+#endif
+
+// module reported by dl_iterate_phdr
+struct loaded_module
+{
+	std::string name;
+	uintptr_t base = 0;
+	std::vector<elf_phdr> phdrs;
+};
+
+// module containing address
+static bool FindLoadedModule(uintptr_t address, loaded_module& module)
+{
+	struct lookup
+	{
+		uintptr_t address;
+		loaded_module* module;
+	} data = { address, &module };
+
+	PATTERNS_DL_ITERATE_PHDR([](struct dl_phdr_info* info, size_t size, void* data) -> int
+		{
+			lookup* arg = reinterpret_cast<lookup*>(data);
+			if (info->dlpi_phdr == nullptr)
+			{
+				return 0;
+			}
+			for (int i = 0; i < info->dlpi_phnum; i++)
+			{
+				const elf_phdr& phdr = info->dlpi_phdr[i];
+				uintptr_t begin = info->dlpi_addr + phdr.p_vaddr;
+				if (phdr.p_type == PT_LOAD && begin <= arg->address && arg->address < begin + phdr.p_memsz)
+				{
+					arg->module->name = (info->dlpi_name != nullptr) ? info->dlpi_name : "";
+					arg->module->base = info->dlpi_addr;
+					arg->module->phdrs.assign(info->dlpi_phdr, info->dlpi_phdr + info->dlpi_phnum);
+					return 1; // exit
+				}
+			}
+			return 0;
+		}, &data);
+
+	return !module.phdrs.empty();
+}
+
+// instruction alignment of the module containing address, from e_machine (1 if unknown)
+static size_t GetModuleAlignment(uintptr_t address)
+{
+	// key: lib_name : load bias, value: alignment
+	static std::map<std::pair<std::string, uintptr_t>, size_t> alignments;
+	static std::mutex mutex;
+
+	loaded_module module;
+	if (!FindLoadedModule(address, module))
+	{
+		return 1;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto key = std::make_pair(module.name, module.base);
+	auto it = alignments.find(key);
+	if (it != alignments.end())
+	{
+		return it->second;
+	}
+
+	size_t alignment = 1;
+	for (auto& phdr : module.phdrs)
+	{
+		// the elf header is mapped by the segment at file offset 0
+		const Elf_ehdr* ehdr = reinterpret_cast<const Elf_ehdr*>(module.base + phdr.p_vaddr);
+		if (phdr.p_type != PT_LOAD || phdr.p_offset != 0 || memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0)
+		{
+			continue;
+		}
+		switch (ehdr->e_machine)
+		{
+		case EM_AARCH64: alignment = 4; break; // A64
+		case EM_ARM: alignment = 2; break; // Thumb and A32
+		default: alignment = 1; break;
+		}
+		break;
+	}
+
+	PATTERNS_LOGIS("GetModuleAlignment: lib_name: %s, alignment: %zu", module.name.c_str(), alignment);
+	alignments.emplace(key, alignment);
+	return alignment;
+}
+
+// function entry index, built once per module and shared by all patterns
+// sources: .eh_frame_hdr / .ARM.exidx (memory), .dynsym / .symtab / .gnu_debugdata (file)
+class function_index
+{
+private:
+	// key: lib_name : load bias, value: sorted function entries
+	static auto& getIndexes()
+	{
+		static std::map<std::pair<std::string, uintptr_t>, std::shared_ptr<const std::vector<uintptr_t>>> indexes;
+		return indexes;
+	}
+
+	static std::mutex& getMutex()
+	{
+		static std::mutex mutex;
+		return mutex;
+	}
+
+	static inline uintptr_t ClearThumbBit(uintptr_t address)
+	{
+#if defined(__arm__)
+		return address & ~uintptr_t(1);
+#else
+		return address;
+#endif
+	}
+
+	static bool ReadEncoded(const uint8_t*& ptr, uint8_t encoding, uintptr_t dataBase, uintptr_t& value)
+	{
+		const uintptr_t pc = reinterpret_cast<uintptr_t>(ptr);
+		switch (encoding & 0x0F)
+		{
+		case 0x00: value = *reinterpret_cast<const uintptr_t*>(ptr); ptr += sizeof(uintptr_t); break; // DW_EH_PE_absptr
+		case 0x02: value = *reinterpret_cast<const uint16_t*>(ptr); ptr += 2; break; // DW_EH_PE_udata2
+		case 0x03: value = *reinterpret_cast<const uint32_t*>(ptr); ptr += 4; break; // DW_EH_PE_udata4
+		case 0x04: value = static_cast<uintptr_t>(*reinterpret_cast<const uint64_t*>(ptr)); ptr += 8; break; // DW_EH_PE_udata8
+		case 0x0A: value = static_cast<uintptr_t>(*reinterpret_cast<const int16_t*>(ptr)); ptr += 2; break; // DW_EH_PE_sdata2
+		case 0x0B: value = static_cast<uintptr_t>(*reinterpret_cast<const int32_t*>(ptr)); ptr += 4; break; // DW_EH_PE_sdata4
+		case 0x0C: value = static_cast<uintptr_t>(*reinterpret_cast<const int64_t*>(ptr)); ptr += 8; break; // DW_EH_PE_sdata8
+		default: return false;
+		}
+		switch (encoding & 0x70)
+		{
+		case 0x00: break; // DW_EH_PE_absptr
+		case 0x10: value += pc; break; // DW_EH_PE_pcrel
+		case 0x30: value += dataBase; break; // DW_EH_PE_datarel
+		default: return false;
+		}
+		return true;
+	}
+
+	static void CollectEhFrameHdr(const loaded_module& module, std::vector<uintptr_t>& entries)
+	{
+		for (auto& phdr : module.phdrs)
+		{
+			if (phdr.p_type != PT_GNU_EH_FRAME || phdr.p_memsz < 4)
+			{
+				continue;
+			}
+
+			const uint8_t* hdr = reinterpret_cast<const uint8_t*>(module.base + phdr.p_vaddr);
+			const uintptr_t hdrBase = reinterpret_cast<uintptr_t>(hdr);
+			const uint8_t version = hdr[0], framePtrEnc = hdr[1], countEnc = hdr[2], tableEnc = hdr[3];
+			if (version != 1 || countEnc == 0xFF || tableEnc == 0xFF) // DW_EH_PE_omit
+			{
+				continue;
+			}
+
+			const uint8_t* ptr = hdr + 4;
+			uintptr_t framePtr = 0, count = 0;
+			if (!ReadEncoded(ptr, framePtrEnc, hdrBase, framePtr) || !ReadEncoded(ptr, countEnc, hdrBase, count))
+			{
+				continue;
+			}
+
+			entries.reserve(entries.size() + count);
+			for (uintptr_t i = 0; i < count; i++)
+			{
+				uintptr_t location = 0, fde = 0;
+				if (!ReadEncoded(ptr, tableEnc, hdrBase, location) || !ReadEncoded(ptr, tableEnc, hdrBase, fde))
+				{
+					PATTERNS_LOGWS("function_index: unsupported .eh_frame_hdr table encoding: 0x%x, lib_name: %s", tableEnc, module.name.c_str());
+					break;
+				}
+				entries.emplace_back(location);
+			}
+		}
+	}
+
+	static void CollectArmExidx(const loaded_module& module, std::vector<uintptr_t>& entries)
+	{
+		for (auto& phdr : module.phdrs)
+		{
+			if (phdr.p_type != PT_ARM_EXIDX)
+			{
+				continue;
+			}
+
+			// each entry: prel31 offset to the function start, unwind word
+			const uint32_t* exidx = reinterpret_cast<const uint32_t*>(module.base + phdr.p_vaddr);
+			for (size_t i = 0, count = phdr.p_memsz / 8; i < count; i++)
+			{
+				const uint32_t* entry = exidx + i * 2;
+				int32_t offset = static_cast<int32_t>(entry[0] << 1) >> 1;
+				entries.emplace_back(ClearThumbBit(reinterpret_cast<uintptr_t>(entry) + offset));
+			}
+		}
+	}
+
+	static void CollectSymbols(const uint8_t* data, size_t size, uintptr_t base, const std::string& name, std::vector<uintptr_t>& entries, bool debugData)
+	{
+		const Elf_ehdr* ehdr = reinterpret_cast<const Elf_ehdr*>(data);
+		if (size < sizeof(Elf_ehdr) || memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 || ehdr->e_shentsize != sizeof(elf_shdr) 
+			|| ehdr->e_shoff == 0 || ehdr->e_shoff + static_cast<size_t>(ehdr->e_shnum) * sizeof(elf_shdr) > size || ehdr->e_shstrndx >= ehdr->e_shnum)
+		{
+			return;
+		}
+
+		const elf_shdr* shdr = reinterpret_cast<const elf_shdr*>(data + ehdr->e_shoff);
+#ifdef PATTERNS_USE_XDL
+		const elf_shdr& shstrtab = shdr[ehdr->e_shstrndx];
+#endif
+		auto InFile = [=](const elf_shdr& section) { return section.sh_type != SHT_NOBITS && section.sh_offset + section.sh_size <= size; };
+
+		for (int i = 0; i < ehdr->e_shnum; i++)
+		{
+			const elf_shdr& section = shdr[i];
+			if (!InFile(section))
+			{
+				continue;
+			}
+
+			if (section.sh_type == SHT_SYMTAB || section.sh_type == SHT_DYNSYM)
+			{
+				const elf_sym* sym = reinterpret_cast<const elf_sym*>(data + section.sh_offset);
+				for (size_t j = 0, count = section.sh_size / sizeof(elf_sym); j < count; j++)
+				{
+					if ((sym[j].st_info & 0xF) == STT_FUNC && sym[j].st_shndx != SHN_UNDEF && sym[j].st_value != 0)
+					{
+						entries.emplace_back(ClearThumbBit(base + sym[j].st_value));
+					}
+				}
+			}
+#ifdef PATTERNS_USE_XDL
+			else if (debugData && InFile(shstrtab) && section.sh_name < shstrtab.sh_size 
+				&& strcmp(reinterpret_cast<const char*>(data + shstrtab.sh_offset + section.sh_name), ".gnu_debugdata") == 0)
+			{
+				// .gnu_debugdata: xz compressed elf, only contains .symtab
+				uint8_t* debug = nullptr;
+				size_t debugSize = 0;
+				if (xdl_lzma_decompress(const_cast<uint8_t*>(data + section.sh_offset), section.sh_size, &debug, &debugSize) == 0)
+				{
+					CollectSymbols(debug, debugSize, base, name, entries, false);
+					free(debug);
+				}
+				else
+				{
+					PATTERNS_LOGWS("function_index: decompress .gnu_debugdata failed: %s", name.c_str());
+				}
+			}
+#endif
+		}
+	}
+
+	static void CollectFileSymbols(const loaded_module& module, std::vector<uintptr_t>& entries)
+	{
+		const char* path = module.name.empty() ? "/proc/self/exe" : module.name.c_str();
+		int fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd == -1)
+		{
+			PATTERNS_LOGES("function_index: open file failed: %s", path);
+			return;
+		}
+		off_t fsize = lseek(fd, 0, SEEK_END);
+		void* fdata = (fsize > 0) ? mmap(nullptr, fsize, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+		close(fd);
+		if (fdata == MAP_FAILED)
+		{
+			PATTERNS_LOGES("function_index: mmap failed: %s", path);
+			return;
+		}
+
+		CollectSymbols(reinterpret_cast<const uint8_t*>(fdata), fsize, module.base, module.name, entries, true);
+		munmap(fdata, fsize);
+	}
+
+public:
+	// sorted function entries of the module containing address, empty if unknown
+	static std::shared_ptr<const std::vector<uintptr_t>> Get(uintptr_t address)
+	{
+		loaded_module module;
+		if (!FindLoadedModule(address, module))
+		{
+			PATTERNS_LOGWS("function_index: no module contains address: " PATTERNS_ADDR_FMT "", address);
+			return std::make_shared<const std::vector<uintptr_t>>();
+		}
+
+		std::lock_guard<std::mutex> lock(getMutex());
+
+		auto key = std::make_pair(module.name, module.base);
+		auto it = getIndexes().find(key);
+		if (it != getIndexes().end())
+		{
+			return it->second;
+		}
+
+		std::vector<uintptr_t> entries;
+		CollectEhFrameHdr(module, entries);
+		CollectArmExidx(module, entries);
+		CollectFileSymbols(module, entries);
+
+		std::sort(entries.begin(), entries.end());
+		entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+		entries.shrink_to_fit();
+
+		PATTERNS_LOGIS("function_index: lib_name: %s, lib_base: " PATTERNS_ADDR_FMT ", functions: %zu", module.name.c_str(), module.base, entries.size());
+
+		auto index = std::make_shared<const std::vector<uintptr_t>>(std::move(entries));
+		getIndexes().emplace(key, index);
+		return index;
+	}
+};
+
+// dl_iterate_phdr load / unload counters, changes whenever a module is loaded or unloaded (0 if unsupported)
+static uint64_t GetModuleGeneration()
+{
+	uint64_t generation = 0;
+	PATTERNS_DL_ITERATE_PHDR([](struct dl_phdr_info* info, size_t size, void* data) -> int
+		{
+			if (size >= offsetof(struct dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs))
+			{
+				*reinterpret_cast<uint64_t*>(data) = info->dlpi_adds + info->dlpi_subs;
+			}
+			return 1; // exit, the counters are the same for every module
+		}, &generation);
+	return generation;
+}
+
+// Horspool scanner over a transformed pattern, masks may cover single bits, byte classes are membership tables
+// and bounded gaps may split it into fragments; with a mismatch budget it becomes Tarhio-Ukkonen
+class pattern_scanner
+{
+private:
+	const uint8_t* m_pattern;
+	const uint8_t* m_mask;
+	size_t m_size; // longest span, the pattern length without gaps
+
+	// fixed fragments between the gaps: first byte, length, gap before it
+	struct fragment
+	{
+		size_t begin;
+		size_t length;
+		size_t minGap;
+		size_t maxGap;
+	};
+	std::vector<fragment> m_fragments;
+	size_t m_minSize;
+
+	// byte classes, checked after the shared bits in m_pattern / m_mask
+	std::vector<details::pattern_class> m_classes;
+
+	// the fragment the Horspool loop looks for, the whole pattern without gaps
+	size_t m_anchor = 0;
+	size_t m_anchorBegin = 0;
+	const uint8_t* m_anchorPattern;
+	const uint8_t* m_anchorMask;
+	size_t m_anchorSize;
+	size_t m_anchorMinOffset = 0; // offset from the match start
+	size_t m_anchorMaxOffset = 0;
+
+	// Horspool shift per byte found under the last anchor position
+	size_t m_shift[256];
+
+	// (mem & mask) == bytes, evaluated 8 bytes at a time
+	std::vector<std::pair<uint64_t, uint64_t>> m_words;
+
+	// up to m_maxMismatches fixed bytes may differ (not gapped), the shift is the smallest one
+	// m_approxShift[q * 256 + byte] allows for the byte found q positions before the last
+	size_t m_maxMismatches = 0;
+	std::vector<size_t> m_approxShift;
+
+#if PATTERNS_USE_STATS
+	mutable uint64_t m_candidates = 0;
+#endif
+
+	// pattern bytes [begin, begin + length) at ptr
+	inline bool InClasses(const uint8_t* ptr, size_t begin, size_t length) const
+	{
+		for (auto& entry : m_classes)
+		{
+			if (entry.position >= begin && entry.position < begin + length && !entry.test(ptr[entry.position - begin]))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	inline bool CompareFragment(const fragment& part, const uint8_t* ptr) const
+	{
+		for (size_t i = 0; i < part.length; i++)
+		{
+			if (m_pattern[part.begin + i] != (ptr[i] & m_mask[part.begin + i]))
+			{
+				return false;
+			}
+		}
+		return InClasses(ptr, part.begin, part.length);
+	}
+
+	// placements over one buffer: level k remembers where fragments k.. can be placed, every level is evaluated
+	// left to right and each position only once, so the gap widths add up instead of multiplying
+	struct placement
+	{
+		struct level
+		{
+			size_t next; // positions below are evaluated or skipped
+			size_t head; // found[head] is the first one a later query may want
+			std::vector<size_t> found;
+		};
+
+		const uint8_t* data;
+		size_t size;
+		std::vector<level> levels;
+	};
+
+	placement& Placement(const uint8_t* data, size_t size) const
+	{
+		static thread_local placement state;
+		state.data = data;
+		state.size = size;
+		state.levels.resize(m_fragments.size());
+		for (auto& level : state.levels)
+		{
+			level.next = 0;
+			level.head = 0;
+			level.found.clear();
+		}
+		return state;
+	}
+
+	// fragment index at position and the rest behind it
+	bool Placeable(placement& state, size_t index, size_t position) const
+	{
+		const fragment& part = m_fragments[index];
+		if (position + part.length > state.size || !CompareFragment(part, state.data + position))
+		{
+			return false;
+		}
+		if (index + 1 == m_fragments.size())
+		{
+			return true;
+		}
+
+		const fragment& next = m_fragments[index + 1];
+		const size_t end = position + part.length;
+		return Reaches(state, index + 1, end + next.minGap, end + next.maxGap);
+	}
+
+	// fragment index is placeable somewhere in [first, last], first never decreases between the queries of a level
+	bool Reaches(placement& state, size_t index, size_t first, size_t last) const
+	{
+		auto& level = state.levels[index];
+		while (level.head < level.found.size() && level.found[level.head] < first)
+		{
+			level.head++;
+		}
+		if (level.head < level.found.size())
+		{
+			return level.found[level.head] <= last;
+		}
+
+		for (level.next = std::max(level.next, first); level.next <= last && level.next < state.size; level.next++)
+		{
+			if (Placeable(state, index, level.next))
+			{
+				level.found.push_back(level.next++);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	inline bool CompareAnchor(const uint8_t* ptr) const
+	{
+		PATTERNS_STATS(m_candidates++);
+
+		size_t i = 0;
+		for (auto& word : m_words)
+		{
+			uint64_t value;
+			memcpy(&value, ptr + i, sizeof(value));
+			if ((value & word.second) != word.first)
+			{
+				return false;
+			}
+			i += sizeof(uint64_t);
+		}
+
+		for (; i < m_anchorSize; i++)
+		{
+			if (m_anchorPattern[i] != (ptr[i] & m_anchorMask[i]))
+			{
+				return false;
+			}
+		}
+		return m_classes.empty() || InClasses(ptr, m_anchorBegin, m_anchorSize);
+	}
+
+public:
+	pattern_scanner(const std::basic_string<uint8_t>& bytes, const std::basic_string<uint8_t>& mask,
+		const std::vector<details::pattern_gap>& gaps = {}, const std::vector<details::pattern_class>& classes = {}, size_t maxMismatches = 0)
+		: m_pattern(bytes.data()), m_mask(mask.data()), m_size(mask.size()), m_minSize(mask.size()), m_classes(classes),
+		m_anchorPattern(bytes.data()), m_anchorMask(mask.data()), m_anchorSize(mask.size())
+	{
+		if (maxMismatches != 0 && gaps.empty() && !mask.empty())
+		{
+			m_maxMismatches = std::min(maxMismatches, mask.size() - 1);
+		}
+
+		if (!gaps.empty())
+		{
+			size_t begin = 0, minGap = 0, maxGap = 0;
+			for (size_t i = 0; i <= gaps.size(); i++)
+			{
+				const size_t end = (i < gaps.size()) ? gaps[i].position : mask.size();
+				m_fragments.push_back({ begin, end - begin, minGap, maxGap });
+				if (i < gaps.size())
+				{
+					begin = end;
+					minGap = gaps[i].min;
+					maxGap = gaps[i].max;
+					m_size += maxGap;
+					m_minSize += minGap;
+				}
+			}
+
+			// the anchor is the fragment with the most fixed bits
+			size_t best = 0;
+			for (size_t i = 0; i < m_fragments.size(); i++)
+			{
+				size_t bits = 0;
+				for (size_t j = 0; j < m_fragments[i].length; j++)
+				{
+					bits += __builtin_popcount(m_mask[m_fragments[i].begin + j]);
+				}
+				if (bits > best)
+				{
+					best = bits;
+					m_anchor = i;
+				}
+			}
+
+			for (size_t i = 0; i < m_anchor; i++)
+			{
+				m_anchorMinOffset += m_fragments[i].length + m_fragments[i + 1].minGap;
+				m_anchorMaxOffset += m_fragments[i].length + m_fragments[i + 1].maxGap;
+			}
+			m_anchorBegin = m_fragments[m_anchor].begin;
+			m_anchorPattern = m_pattern + m_fragments[m_anchor].begin;
+			m_anchorMask = m_mask + m_fragments[m_anchor].begin;
+			m_anchorSize = m_fragments[m_anchor].length;
+		}
+
+		// a masked position (wildcard, nibble or bit mask) matches every byte with (byte & mask) == value,
+		// a class position only its members
+		std::fill(std::begin(m_shift), std::end(m_shift), std::max<size_t>(m_anchorSize, 1));
+		for (size_t i = 0; i + 1 < m_anchorSize; ++i)
+		{
+			auto byteClass = std::find_if(m_classes.begin(), m_classes.end(), [&](const details::pattern_class& entry) { return entry.position == m_anchorBegin + i; });
+			for (int value = 0; value < 256; value++)
+			{
+				if ((value & m_anchorMask[i]) == m_anchorPattern[i] && (byteClass == m_classes.end() || byteClass->test(static_cast<uint8_t>(value))))
+				{
+					m_shift[value] = m_anchorSize - 1 - i;
+				}
+			}
+		}
+
+		for (size_t i = 0; i + sizeof(uint64_t) <= m_anchorSize; i += sizeof(uint64_t))
+		{
+			uint64_t word = 0, wordMask = 0;
+			memcpy(&word, m_anchorPattern + i, sizeof(word));
+			memcpy(&wordMask, m_anchorMask + i, sizeof(wordMask));
+			m_words.emplace_back(word, wordMask);
+		}
+
+		// a window with at most k mismatches agrees with the pattern on one of its last k + 1 bytes,
+		// so the next window is the nearest one which lines up a pattern byte with one of them
+		if (m_maxMismatches != 0)
+		{
+			m_approxShift.resize((m_maxMismatches + 1) * 256);
+			for (size_t q = 0; q <= m_maxMismatches; q++)
+			{
+				const size_t at = m_size - 1 - q;
+				size_t* shift = m_approxShift.data() + q * 256;
+				std::fill(shift, shift + 256, at + 1);
+				for (size_t i = 0; i < at; i++)
+				{
+					auto byteClass = std::find_if(m_classes.begin(), m_classes.end(), [&](const details::pattern_class& entry) { return entry.position == i; });
+					for (int value = 0; value < 256; value++)
+					{
+						if ((value & m_mask[i]) == m_pattern[i] && (byteClass == m_classes.end() || byteClass->test(static_cast<uint8_t>(value))))
+						{
+							shift[value] = at - i;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	// longest span of a match
+	inline size_t size() const
+	{
+		return m_size;
+	}
+
+	// shortest span of a match
+	inline size_t minSize() const
+	{
+		return m_minSize;
+	}
+
+	inline bool gapped() const
+	{
+		return !m_fragments.empty();
+	}
+
+	inline size_t shift(uint8_t value) const
+	{
+		return m_shift[value];
+	}
+
+#if PATTERNS_USE_STATS
+	inline uint64_t candidates() const
+	{
+		return m_candidates;
+	}
+#endif
+
+	inline size_t maxMismatches() const
+	{
+		return m_maxMismatches;
+	}
+
+	// heap blocks with copies of the pattern bytes in them
+	std::vector<std::pair<uintptr_t, uintptr_t>> storage() const
+	{
+		std::vector<std::pair<uintptr_t, uintptr_t>> result;
+		if (!m_words.empty())
+		{
+			result.emplace_back(reinterpret_cast<uintptr_t>(m_words.data()), reinterpret_cast<uintptr_t>(m_words.data() + m_words.size()));
+		}
+		return result;
+	}
+
+	// differing fixed bytes at ptr (not gapped, size() bytes are readable), a class byte counts when it misses the class;
+	// the count stops once it is past limit
+	inline size_t Mismatches(const uint8_t* ptr, size_t limit = SIZE_MAX) const
+	{
+		size_t count = 0, i = 0;
+		for (auto& word : m_words)
+		{
+			uint64_t value;
+			memcpy(&value, ptr + i, sizeof(value));
+
+			// fold every differing byte into its lowest bit
+			uint64_t diff = (value & word.second) ^ word.first;
+			diff |= diff >> 4;
+			diff |= diff >> 2;
+			diff |= diff >> 1;
+			count += __builtin_popcountll(diff & 0x0101010101010101ull);
+			if (count > limit)
+			{
+				return count;
+			}
+			i += sizeof(uint64_t);
+		}
+
+		for (; i < m_size; i++)
+		{
+			count += (m_pattern[i] != (ptr[i] & m_mask[i]));
+		}
+		for (auto& entry : m_classes)
+		{
+			const size_t at = entry.position;
+			count += ((ptr[at] & m_mask[at]) == m_pattern[at] && !entry.test(ptr[at]));
+		}
+		return count;
+	}
+
+	// match starting at ptr, size() bytes are readable
+	inline bool Compare(const uint8_t* ptr) const
+	{
+		if (m_maxMismatches != 0)
+		{
+			PATTERNS_STATS(m_candidates++);
+			return Mismatches(ptr, m_maxMismatches) <= m_maxMismatches;
+		}
+		if (gapped())
+		{
+			PATTERNS_STATS(m_candidates++);
+			return Placeable(Placement(ptr, m_size), 0, 0);
+		}
+		return CompareAnchor(ptr);
+	}
+
+	// match starting at ptr, available bytes are readable
+	inline bool Compare(const uint8_t* ptr, size_t available) const
+	{
+		if (gapped())
+		{
+			PATTERNS_STATS(m_candidates++);
+			return available >= m_minSize && Placeable(Placement(ptr, available), 0, 0);
+		}
+		return available >= m_size && Compare(ptr);
+	}
+
+	// scan a buffer which mirrors the memory at address, found(address) returns true to stop
+	// align: only candidates at addresses aligned to it (power of two), the shift is rounded up to it
+	// a gapped pattern is found by its anchor fragment and reports every start its anchor hits allow which places,
+	// the same start may be reported again by the overlapping buffers of a range
+	template<typename Found>
+	bool Scan(const uint8_t* data, size_t size, uintptr_t address, Found&& found, size_t align = 1) const
+	{
+		if (size < m_minSize || m_anchorSize == 0)
+		{
+			return false;
+		}
+
+		const size_t last = m_anchorSize - 1;
+		const size_t alignMask = align - 1;
+		if (m_maxMismatches != 0)
+		{
+			for (size_t i = (align - (address & alignMask)) & alignMask, ends = size - m_size; i <= ends;)
+			{
+				const uint8_t* ptr = data + i;
+				PATTERNS_STATS(m_candidates++);
+				if (Mismatches(ptr, m_maxMismatches) <= m_maxMismatches && found(address + i))
+				{
+					return true;
+				}
+
+				size_t shift = m_size;
+				for (size_t q = 0; q <= m_maxMismatches; q++)
+				{
+					shift = std::min(shift, m_approxShift[q * 256 + ptr[last - q]]);
+				}
+				i += (shift + alignMask) & ~alignMask;
+			}
+			return false;
+		}
+
+		if (!gapped())
+		{
+			for (size_t i = (align - (address & alignMask)) & alignMask, ends = size - m_size; i <= ends;)
+			{
+				const uint8_t* ptr = data + i;
+				const uint8_t tail = ptr[last];
+
+				if ((tail & m_anchorMask[last]) == m_anchorPattern[last] && CompareAnchor(ptr))
+				{
+					if (found(address + i))
+					{
+						return true;
+					}
+				}
+
+				i += (m_shift[tail] + alignMask) & ~alignMask;
+			}
+			return false;
+		}
+
+		// the anchor may sit anywhere its offset range allows, the alignment applies to the match start;
+		// the starts an anchor hit allows are tested once, in order, against the whole pattern
+		placement& state = Placement(data, size);
+		size_t nextStart = 0;
+		for (size_t i = m_anchorMinOffset, ends = size - m_anchorSize; i <= ends;)
+		{
+			const uint8_t* ptr = data + i;
+			const uint8_t tail = ptr[last];
+
+			if ((tail & m_anchorMask[last]) == m_anchorPattern[last] && CompareAnchor(ptr))
+			{
+				const size_t lastStart = i - m_anchorMinOffset;
+				for (size_t start = std::max(nextStart, (i > m_anchorMaxOffset) ? i - m_anchorMaxOffset : 0); start <= lastStart; start++)
+				{
+					if (((address + start) & alignMask) == 0 && Placeable(state, 0, start) && found(address + start))
+					{
+						return true;
+					}
+				}
+				nextStart = std::max(nextStart, lastStart + 1);
+			}
+
+			i += m_shift[tail];
+		}
+		return false;
+	}
+};
+
+// residency scheduler counters
+struct prefetch_counters
+{
+	std::atomic<uint64_t> residentPages{ 0 };
+	std::atomic<uint64_t> coldPages{ 0 };
+	std::atomic<uint64_t> prefetchedPages{ 0 };
+	std::atomic<uint64_t> faultsAvoided{ 0 };
+};
+
+static auto& getPrefetchCounters()
+{
+	static prefetch_counters counters;
+	return counters;
+}
+
+prefetch_stats get_prefetch_stats()
+{
+	auto& counters = getPrefetchCounters();
+	return { counters.residentPages.load(), counters.coldPages.load(), counters.prefetchedPages.load(), counters.faultsAvoided.load() };
+}
+
+// cached /proc/self/maps, refreshed when the module generation changes, an unknown range is requested or a cached mapping is gone
+class memory_maps
+{
+public:
+	struct region
+	{
+		uintptr_t begin;
+		uintptr_t end;
+		int prot;
+		std::string path;
+		uint32_t source; // memory_sources kind, 0: a module or a special mapping
+	};
+
+private:
+	static auto& getRegions()
+	{
+		static std::vector<region> regions;
+		return regions;
+	}
+
+	static std::mutex& getMutex()
+	{
+		static std::mutex mutex;
+		return mutex;
+	}
+
+	static uint64_t& getGeneration()
+	{
+		static uint64_t generation = 0;
+		return generation;
+	}
+
+	// requested ranges which had a hole right after a load, they do not reload the table on every scan
+	static auto& getHoles()
+	{
+		static std::vector<std::pair<uintptr_t, uintptr_t>> holes;
+		return holes;
+	}
+
+	static uint32_t Classify(const region& info)
+	{
+		const std::string& path = info.path;
+		auto startsWith = [&](const char* prefix) { return path.compare(0, strlen(prefix), prefix) == 0; };
+
+		if ((info.prot & PROT_READ) == 0)
+		{
+			return 0;
+		}
+		if (path == "[heap]" || startsWith("[anon:libc_malloc") || startsWith("[anon:scudo:") || startsWith("[anon:jemalloc"))
+		{
+			return memory_sources::heap;
+		}
+
+		// file-backed modules and [stack], [vdso], [vvar] ... are not sources, memfd and ashmem are anonymous memory with a name
+		if (!path.empty() && !startsWith("[anon:") && !startsWith("/memfd:") && !startsWith("/dev/ashmem/"))
+		{
+			return 0;
+		}
+		if (info.prot & PROT_EXEC)
+		{
+			return memory_sources::jit;
+		}
+		return (info.prot & PROT_WRITE) ? memory_sources::anonymous : 0;
+	}
+
+	static void Load()
+	{
+		auto& regions = getRegions();
+		regions.clear();
+
+		std::string buffer;
+		std::ifstream fp("/proc/self/maps");
+		if (fp)
+		{
+			while (std::getline(fp, buffer))
+			{
+				// begin-end perms offset dev inode path
+				char* cursor = nullptr;
+				region info{};
+				info.begin = std::strtoul(buffer.c_str(), &cursor, 16);
+				if (*cursor != '-')
+				{
+					continue;
+				}
+				info.end = std::strtoul(cursor + 1, &cursor, 16);
+				if (strlen(cursor) < 5)
+				{
+					continue;
+				}
+				info.prot = (cursor[1] == 'r' ? PROT_READ : 0) | (cursor[2] == 'w' ? PROT_WRITE : 0) | (cursor[3] == 'x' ? PROT_EXEC : 0);
+
+				size_t path = buffer.find_first_of("/[");
+				if (path != std::string::npos)
+				{
+					info.path = buffer.substr(path);
+				}
+				info.source = Classify(info);
+				regions.emplace_back(std::move(info));
+			}
+			fp.close();
+		}
+
+		if (regions.empty())
+		{
+			PATTERNS_LOGE("memory_maps: read /proc/self/maps failed.");
+		}
+		getGeneration() = GetModuleGeneration();
+		getHoles().clear();
+	}
+
+	// reloads the table when it is missing, from an older module generation or does not map [begin, end),
+	// returns false when the table was kept and its entries are not confirmed
+	static bool Ensure(uintptr_t begin, uintptr_t end)
+	{
+		if (!getRegions().empty() && getGeneration() == GetModuleGeneration())
+		{
+			auto& holes = getHoles();
+			if (Covers(begin, end) || std::any_of(holes.begin(), holes.end(), [&](const auto& hole) { return hole.first <= begin && end <= hole.second; }))
+			{
+				return false;
+			}
+		}
+
+		Load();
+		if (!Covers(begin, end) && getHoles().size() < 64)
+		{
+			getHoles().emplace_back(begin, end);
+		}
+		return true;
+	}
+
+	// the first and last byte of every readable mapping over [begin, end) can still be read, a cached entry
+	// which has been unmapped or protected since (a new guard page) fails it
+	static bool Probe(uintptr_t begin, uintptr_t end)
+	{
+		iovec remote[64];
+		uint8_t local[64];
+		int count = 0;
+
+		auto Flush = [&]() -> bool
+		{
+			iovec target = { local, static_cast<size_t>(count) };
+			const bool ok = count == 0 || syscall(__NR_process_vm_readv, getpid(), &target, 1, remote, count, 0) == count;
+			count = 0;
+			return ok;
+		};
+		auto Add = [&](uintptr_t address) -> bool
+		{
+			remote[count].iov_base = reinterpret_cast<void*>(address);
+			remote[count].iov_len = 1;
+			return ++count < 64 || Flush();
+		};
+
+		auto& regions = getRegions();
+		auto it = std::upper_bound(regions.begin(), regions.end(), begin, [](uintptr_t address, const region& info) { return address < info.end; });
+		for (; it != regions.end() && it->begin < end; ++it)
+		{
+			if ((it->prot & PROT_READ) != 0 && (!Add(std::max(begin, it->begin)) || !Add(std::min(end, it->end) - 1)))
+			{
+				return false;
+			}
+		}
+		return Flush();
+	}
+
+	// mmap/munmap/brk do not change the module generation, a range which is not fully mapped in the cache reloads it
+	static bool Covers(uintptr_t begin, uintptr_t end)
+	{
+		auto& regions = getRegions();
+		auto it = std::upper_bound(regions.begin(), regions.end(), begin, [](uintptr_t address, const region& info) { return address < info.end; });
+		for (uintptr_t next = begin; it != regions.end() && it->begin <= next; ++it)
+		{
+			next = it->end;
+			if (next >= end)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+public:
+	static void Invalidate()
+	{
+		std::lock_guard<std::mutex> lock(getMutex());
+		getRegions().clear();
+	}
+
+	// readable parts of [begin, end), adjacent readable mappings are merged
+	static std::vector<std::pair<uintptr_t, uintptr_t>> Readable(uintptr_t begin, uintptr_t end)
+	{
+		std::vector<std::pair<uintptr_t, uintptr_t>> result;
+		std::lock_guard<std::mutex> lock(getMutex());
+
+		// the scan reads these ranges directly, cached entries are checked before they are trusted
+		if (!Ensure(begin, end) && !Probe(begin, end))
+		{
+			Load();
+		}
+
+		auto& regions = getRegions();
+		auto it = std::upper_bound(regions.begin(), regions.end(), begin, [](uintptr_t address, const region& info) { return address < info.end; });
+		for (; it != regions.end() && it->begin < end; ++it)
+		{
+			if ((it->prot & PROT_READ) == 0)
+			{
+				continue;
+			}
+
+			uintptr_t first = std::max(begin, it->begin), second = std::min(end, it->end);
+			if (!result.empty() && result.back().second == first)
+			{
+				result.back().second = second;
+			}
+			else
+			{
+				result.emplace_back(first, second);
+			}
+		}
+		return result;
+	}
+
+	// mappings of the wanted kinds and sizes without the private ranges and skipped (disjoint heap blocks),
+	// the table is reloaded when modules are loaded / unloaded or on Invalidate; the scans copy these ranges,
+	// a mapping which is gone since reads as a hole
+	static std::vector<std::pair<uintptr_t, uintptr_t>> Sources(const memory_sources& sources, const std::vector<std::pair<uintptr_t, uintptr_t>>& skipped = {})
+	{
+		std::vector<std::pair<uintptr_t, uintptr_t>> result;
+		std::lock_guard<std::mutex> lock(getMutex());
+
+		if (getRegions().empty() || getGeneration() != GetModuleGeneration())
+		{
+			Load();
+		}
+
+		std::lock_guard<std::mutex> privateLock(getPrivateMutex());
+		std::map<uintptr_t, uintptr_t> merged;
+		const std::map<uintptr_t, uintptr_t>* ranges = &getPrivate();
+		if (!skipped.empty())
+		{
+			merged = *ranges;
+			for (auto& range : skipped)
+			{
+				if (range.first < range.second)
+				{
+					merged.emplace(range.first, range.second);
+				}
+			}
+			ranges = &merged;
+		}
+		auto& excluded = *ranges;
+		for (auto& info : getRegions())
+		{
+			const size_t size = info.end - info.begin;
+			if ((info.source & sources.kinds) == 0 || size < sources.min_size || size > sources.max_size)
+			{
+				continue;
+			}
+
+			// the kernel may have merged a private mapping into its neighbour
+			uintptr_t begin = info.begin;
+			for (auto it = excluded.upper_bound(begin); it != excluded.begin() && std::prev(it)->second > begin; it = excluded.upper_bound(begin))
+			{
+				begin = std::prev(it)->second;
+			}
+			for (auto it = excluded.lower_bound(begin); begin < info.end; ++it)
+			{
+				const uintptr_t end = (it == excluded.end()) ? info.end : std::min(info.end, it->first);
+				if (begin < end)
+				{
+					result.emplace_back(begin, end);
+				}
+				if (it == excluded.end())
+				{
+					break;
+				}
+				begin = std::max(begin, it->second);
+			}
+		}
+		return result;
+	}
+
+	// value scan state, see details::allocate_private
+	static std::map<uintptr_t, uintptr_t>& getPrivate()
+	{
+		static std::map<uintptr_t, uintptr_t> ranges;
+		return ranges;
+	}
+
+	static std::mutex& getPrivateMutex()
+	{
+		static std::mutex mutex;
+		return mutex;
+	}
+
+	// mappings over [begin, end), clipped to it
+	static std::vector<region> Mappings(uintptr_t begin, uintptr_t end)
+	{
+		std::vector<region> result;
+		std::lock_guard<std::mutex> lock(getMutex());
+
+		Ensure(begin, end);
+
+		auto& regions = getRegions();
+		auto it = std::upper_bound(regions.begin(), regions.end(), begin, [](uintptr_t address, const region& info) { return address < info.end; });
+		for (; it != regions.end() && it->begin < end; ++it)
+		{
+			result.push_back(*it);
+			result.back().begin = std::max(begin, it->begin);
+			result.back().end = std::min(end, it->end);
+		}
+		return result;
+	}
+
+	// mapping containing address
+	static bool Find(uintptr_t address, region& result)
+	{
+		std::lock_guard<std::mutex> lock(getMutex());
+		Ensure(address, address + 1);
+
+		auto& regions = getRegions();
+		auto it = std::upper_bound(regions.begin(), regions.end(), address, [](uintptr_t address, const region& info) { return address < info.end; });
+		if (it == regions.end() || it->begin > address)
+		{
+			return false;
+		}
+		result = *it;
+		return true;
+	}
+
+	// copy from our own address space without faulting, stops at the first unreadable page
+	static size_t ReadSelf(void* buffer, uintptr_t address, size_t size)
+	{
+		static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+		// split the remote side per page, partial transfers never split an iovec element
+		iovec remote[64];
+		size_t total = 0;
+		while (total < size)
+		{
+			int count = 0;
+			size_t batch = 0;
+			for (uintptr_t cursor = address + total; count < 64 && total + batch < size; count++)
+			{
+				size_t length = std::min(pageSize - (cursor & (pageSize - 1)), size - total - batch);
+				remote[count].iov_base = reinterpret_cast<void*>(cursor);
+				remote[count].iov_len = length;
+				cursor += length;
+				batch += length;
+			}
+
+			iovec local = { reinterpret_cast<uint8_t*>(buffer) + total, batch };
+			ssize_t read = syscall(__NR_process_vm_readv, getpid(), &local, 1, remote, count, 0);
+			if (read <= 0)
+			{
+				break;
+			}
+			total += read;
+			if (static_cast<size_t>(read) < batch)
+			{
+				break;
+			}
+		}
+		return total;
+	}
+};
+
+void refresh_memory_maps()
+{
+	memory_maps::Invalidate();
+}
+
+patch_transaction& patch_transaction::write(void* address, const void* data, size_t size)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	m_writes.push_back({ reinterpret_cast<uintptr_t>(address), std::basic_string<uint8_t>(bytes, bytes + size), {} });
+	return *this;
+}
+
+patch_transaction& patch_transaction::fill(void* address, uint8_t value, size_t size)
+{
+	m_writes.push_back({ reinterpret_cast<uintptr_t>(address), std::basic_string<uint8_t>(size, value), {} });
+	return *this;
+}
+
+bool patch_transaction::commit()
+{
+	if (m_committed)
+	{
+		PATTERNS_LOGE("patch_transaction: already committed");
+		return false;
+	}
+	m_committed = true;
+	return Apply(false);
+}
+
+bool patch_transaction::revert()
+{
+	if (!m_committed)
+	{
+		return false;
+	}
+	m_committed = false;
+	return Apply(true);
+}
+
+void patch_transaction::clear()
+{
+	m_writes.clear();
+	m_committed = false;
+}
+
+bool patch_transaction::Apply(bool revert)
+{
+	static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+	// pages written, in runs of adjacent pages
+	std::vector<std::pair<uintptr_t, uintptr_t>> runs;
+	for (auto& write : m_writes)
+	{
+		if (!write.bytes.empty())
+		{
+			runs.emplace_back(write.address & ~(pageSize - 1), (write.address + write.bytes.size() + pageSize - 1) & ~(pageSize - 1));
+		}
+	}
+	std::sort(runs.begin(), runs.end());
+	size_t merged = 0;
+	for (size_t i = 1; i < runs.size(); i++)
+	{
+		if (runs[i].first <= runs[merged].second)
+		{
+			runs[merged].second = std::max(runs[merged].second, runs[i].second);
+		}
+		else
+		{
+			runs[++merged] = runs[i];
+		}
+	}
+	runs.resize(runs.empty() ? 0 : merged + 1);
+
+	bool result = true;
+	size_t protects = 0;
+	for (auto& run : runs)
+	{
+		// one mprotect per mapping of the run, a run which is not fully mapped is left alone
+		auto mappings = memory_maps::Mappings(run.first, run.second);
+		uintptr_t covered = run.first;
+		for (auto& mapping : mappings)
+		{
+			covered = (mapping.begin == covered) ? mapping.end : covered;
+		}
+		if (covered != run.second)
+		{
+			PATTERNS_LOGES("patch_transaction: not mapped, begin: " PATTERNS_ADDR_FMT ", end: " PATTERNS_ADDR_FMT "", run.first, run.second);
+			result = false;
+			continue;
+		}
+
+		size_t opened = 0;
+		bool executable = false;
+		for (; opened < mappings.size(); opened++)
+		{
+			const auto& mapping = mappings[opened];
+			void* begin = reinterpret_cast<void*>(mapping.begin);
+			executable |= (mapping.prot & PROT_EXEC) != 0;
+			if ((mapping.prot & PROT_WRITE) != 0)
+			{
+				continue;
+			}
+			// W^X kernels refuse rwx, the pages are then not executable while they are written
+			if (mprotect(begin, mapping.end - mapping.begin, mapping.prot | PROT_WRITE) != 0 &&
+				mprotect(begin, mapping.end - mapping.begin, (mapping.prot & ~PROT_EXEC) | PROT_WRITE) != 0)
+			{
+				PATTERNS_LOGES("patch_transaction: mprotect failed: %d - %s, begin: " PATTERNS_ADDR_FMT "", errno, strerror(errno), mapping.begin);
+				break;
+			}
+			protects++;
+		}
+
+		uintptr_t low = run.second, high = run.first;
+		if (opened == mappings.size())
+		{
+			auto Write = [&](patch_write& write)
+			{
+				if (write.address < run.first || write.address >= run.second || write.bytes.empty())
+				{
+					return;
+				}
+				uint8_t* target = reinterpret_cast<uint8_t*>(write.address);
+				if (revert)
+				{
+					memcpy(target, write.original.data(), write.original.size());
+				}
+				else
+				{
+					write.original.assign(target, target + write.bytes.size());
+					memcpy(target, write.bytes.data(), write.bytes.size());
+				}
+				low = std::min(low, write.address);
+				high = std::max(high, write.address + write.bytes.size());
+			};
+			if (revert)
+			{
+				std::for_each(m_writes.rbegin(), m_writes.rend(), Write);
+			}
+			else
+			{
+				std::for_each(m_writes.begin(), m_writes.end(), Write);
+			}
+		}
+		else
+		{
+			result = false;
+		}
+
+		for (size_t i = 0; i < opened; i++)
+		{
+			if ((mappings[i].prot & PROT_WRITE) == 0)
+			{
+				mprotect(reinterpret_cast<void*>(mappings[i].begin), mappings[i].end - mappings[i].begin, mappings[i].prot);
+				protects++;
+			}
+		}
+
+		if (executable && low < high)
+		{
+			__builtin___clear_cache(reinterpret_cast<char*>(low), reinterpret_cast<char*>(high));
+		}
+	}
+
+	PATTERNS_LOGIS("patch_transaction: %s, writes: %zu, page runs: %zu, mprotect calls: %zu", revert ? "revert" : "commit", m_writes.size(), runs.size(), protects);
+	return result;
+}
+
+// ranges of an incremental pattern and the pages written since they were last looked at
+struct details::dirty_watch
+{
+	struct range
+	{
+		uintptr_t begin; // page aligned
+		uintptr_t end;
+		uintptr_t scanBegin; // the range as it was scanned
+		uintptr_t scanEnd;
+		size_t align; // candidate alignment the range was scanned with
+		std::vector<uint64_t> dirty; // one bit per page
+		std::vector<uint64_t> hashes; // one per page, without soft-dirty bits
+	};
+
+	std::vector<range> ranges;
+};
+
+// soft-dirty bits are cleared for the whole process, so every watch collects its dirty pages before any clear;
+// kernels without CONFIG_MEM_SOFT_DIRTY (or without access to pagemap) compare page hashes instead
+class dirty_tracker
+{
+private:
+	static std::mutex& getMutex()
+	{
+		static std::mutex mutex;
+		return mutex;
+	}
+
+	static auto& getWatches()
+	{
+		static std::vector<std::weak_ptr<details::dirty_watch>> watches;
+		return watches;
+	}
+
+	static size_t PageSize()
+	{
+		static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		return pageSize;
+	}
+
+	static bool ClearRefs()
+	{
+		int fd = open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+		if (fd == -1)
+		{
+			return false;
+		}
+		bool written = (write(fd, "4", 1) == 1);
+		close(fd);
+		return written;
+	}
+
+	// bit 55 of the pagemap entries of [begin, end) into dirty
+	static bool ReadSoftDirty(uintptr_t begin, uintptr_t end, std::vector<uint64_t>& dirty)
+	{
+		int fd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+		if (fd == -1)
+		{
+			return false;
+		}
+
+		uint64_t entries[512];
+		const size_t pages = (end - begin) / PageSize();
+		bool valid = true;
+		for (size_t page = 0; page < pages && valid;)
+		{
+			const size_t count = std::min<size_t>(512, pages - page);
+			const off_t offset = static_cast<off_t>((begin / PageSize() + page) * sizeof(uint64_t));
+			valid = (pread(fd, entries, count * sizeof(uint64_t), offset) == static_cast<ssize_t>(count * sizeof(uint64_t)));
+			for (size_t i = 0; valid && i < count; i++, page++)
+			{
+				dirty[page >> 6] |= ((entries[i] >> 55) & 1) << (page & 63);
+			}
+		}
+		close(fd);
+		return valid;
+	}
+
+	static bool SoftDirty()
+	{
+		static const bool supported = []()
+		{
+			// a page written after the clear has to show up
+			void* probe = mmap(nullptr, PageSize(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (probe == MAP_FAILED)
+			{
+				return false;
+			}
+			std::vector<uint64_t> dirty(1);
+			*static_cast<volatile uint8_t*>(probe) = 1;
+			bool result = ClearRefs() && ReadSoftDirty(reinterpret_cast<uintptr_t>(probe), reinterpret_cast<uintptr_t>(probe) + PageSize(), dirty) && dirty[0] == 0;
+			*static_cast<volatile uint8_t*>(probe) = 2;
+			result = result && ReadSoftDirty(reinterpret_cast<uintptr_t>(probe), reinterpret_cast<uintptr_t>(probe) + PageSize(), dirty) && dirty[0] == 1;
+			munmap(probe, PageSize());
+			PATTERNS_LOGIS("dirty_tracker: soft-dirty bits: %s", result ? "yes" : "no, page hashes");
+			return result;
+		}();
+		return supported;
+	}
+
+	static uint64_t HashPage(uintptr_t page)
+	{
+		// copied first, a page unmapped since it was watched reads as zeros instead of faulting
+		static thread_local std::vector<uint64_t> words;
+		words.assign(PageSize() / sizeof(uint64_t), 0);
+		memory_maps::ReadSelf(words.data(), page, PageSize());
+
+		// four independent lanes keep the multiplies from serialising
+		uint64_t lanes[4] = { 1, 2, 3, 4 };
+		for (size_t i = 0; i < PageSize() / sizeof(uint64_t); i += 4)
+		{
+			for (size_t j = 0; j < 4; j++)
+			{
+				lanes[j] = (lanes[j] ^ words[i + j]) * 0x100000001B3ull;
+			}
+		}
+		return lanes[0] ^ (lanes[1] << 1) ^ (lanes[2] << 2) ^ (lanes[3] << 3);
+	}
+
+	// with the mutex held: soft-dirty bits of every live watch, then one clear for all of them
+	static void CollectAndClear()
+	{
+		auto& watches = getWatches();
+		watches.erase(std::remove_if(watches.begin(), watches.end(), [](const auto& watch) { return watch.expired(); }), watches.end());
+		for (auto& weak : watches)
+		{
+			auto watch = weak.lock();
+			for (auto& range : watch->ranges)
+			{
+				ReadSoftDirty(range.begin, range.end, range.dirty);
+			}
+		}
+		ClearRefs();
+	}
+
+public:
+	static std::shared_ptr<details::dirty_watch> Create()
+	{
+		auto watch = std::make_shared<details::dirty_watch>();
+		std::lock_guard<std::mutex> lock(getMutex());
+		getWatches().emplace_back(watch);
+		return watch;
+	}
+
+	// once per resolve, before any range is scanned: the ranges it watches start from this clear
+	static void Begin()
+	{
+		std::lock_guard<std::mutex> lock(getMutex());
+		if (SoftDirty())
+		{
+			CollectAndClear();
+		}
+	}
+
+	// start watching [begin, end) after a Begin, a range which is already watched is left as it is
+	static void Watch(details::dirty_watch& watch, uintptr_t scanBegin, uintptr_t scanEnd, size_t align)
+	{
+		const uintptr_t begin = scanBegin & ~(PageSize() - 1);
+		const uintptr_t end = (scanEnd + PageSize() - 1) & ~(PageSize() - 1);
+
+		std::lock_guard<std::mutex> lock(getMutex());
+		if (std::any_of(watch.ranges.begin(), watch.ranges.end(), [&](const auto& range) { return range.begin == begin; }))
+		{
+			return;
+		}
+
+		details::dirty_watch::range range{ begin, end, scanBegin, scanEnd, align, std::vector<uint64_t>(((end - begin) / PageSize() + 63) / 64), {} };
+		if (!SoftDirty())
+		{
+			for (uintptr_t page = begin; page < end; page += PageSize())
+			{
+				range.hashes.push_back(HashPage(page));
+			}
+		}
+		watch.ranges.emplace_back(std::move(range));
+	}
+
+	// runs of pages written since the last call, per watched range; false if a range is no longer mapped as it was
+	static bool TakeDirty(details::dirty_watch& watch, std::vector<std::tuple<size_t, uintptr_t, uintptr_t>>& runs)
+	{
+		for (auto& range : watch.ranges)
+		{
+			auto readable = memory_maps::Readable(range.begin, range.end);
+			if (readable.size() != 1 || readable[0].first != range.begin || readable[0].second != range.end)
+			{
+				return false;
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(getMutex());
+		if (SoftDirty())
+		{
+			CollectAndClear();
+		}
+
+		for (size_t index = 0; index < watch.ranges.size(); index++)
+		{
+			auto& range = watch.ranges[index];
+			const size_t pages = (range.end - range.begin) / PageSize();
+			for (size_t page = 0; page < pages; page++)
+			{
+				bool dirty;
+				if (range.hashes.empty())
+				{
+					dirty = (range.dirty[page >> 6] >> (page & 63)) & 1;
+				}
+				else
+				{
+					const uint64_t hash = HashPage(range.begin + page * PageSize());
+					dirty = (hash != range.hashes[page]);
+					range.hashes[page] = hash;
+				}
+				if (!dirty)
+				{
+					continue;
+				}
+
+				const uintptr_t address = range.begin + page * PageSize();
+				if (!runs.empty() && std::get<0>(runs.back()) == index && std::get<2>(runs.back()) == address)
+				{
+					std::get<2>(runs.back()) = address + PageSize();
+				}
+				else
+				{
+					runs.emplace_back(index, address, address + PageSize());
+				}
+			}
+			std::fill(range.dirty.begin(), range.dirty.end(), 0);
+		}
+		return true;
+	}
+};
+
+namespace details
+{
+	void* allocate_private(size_t size)
+	{
+		static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		const size_t length = (std::max<size_t>(size, 1) + pageSize - 1) & ~(pageSize - 1);
+		void* address = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (address == MAP_FAILED)
+		{
+			PATTERNS_LOGES("allocate_private: mmap failed: %d - %s", errno, strerror(errno));
+			return malloc(size);
+		}
+
+		std::lock_guard<std::mutex> lock(memory_maps::getPrivateMutex());
+		memory_maps::getPrivate().emplace(reinterpret_cast<uintptr_t>(address), reinterpret_cast<uintptr_t>(address) + length);
+		return address;
+	}
+
+	void free_private(void* address, size_t size)
+	{
+		static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		{
+			std::lock_guard<std::mutex> lock(memory_maps::getPrivateMutex());
+			if (memory_maps::getPrivate().erase(reinterpret_cast<uintptr_t>(address)) == 0)
+			{
+				free(address);
+				return;
+			}
+		}
+		munmap(address, (std::max<size_t>(size, 1) + pageSize - 1) & ~(pageSize - 1));
+	}
+}
+
+// persistent workers for the section header parsing, created on demand (up to 4) and never destroyed:
+// they may still be waiting on the queue when the process exits
+class parse_pool
+{
+private:
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::deque<std::function<void()>> m_tasks;
+	size_t m_workers = 0;
+	size_t m_idle = 0;
+
+	void Work()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true)
+		{
+			m_idle++;
+			m_condition.wait(lock, [this]() { return !m_tasks.empty(); });
+			m_idle--;
+
+			auto task = std::move(m_tasks.front());
+			m_tasks.pop_front();
+			lock.unlock();
+			task();
+			lock.lock();
+		}
+	}
+
+public:
+	static parse_pool& Get()
+	{
+		static parse_pool* pool = new parse_pool();
+		return *pool;
+	}
+
+	static size_t Size()
+	{
+		return std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), 4);
+	}
+
+	// the task must not throw
+	void Submit(std::function<void()> task)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_tasks.push_back(std::move(task));
+		if (m_idle < m_tasks.size() && m_workers < Size())
+		{
+			std::thread(&parse_pool::Work, this).detach();
+			m_workers++;
+		}
+		m_condition.notify_one();
+	}
+};
+
+class executable_meta
+{
+private:
+	// file section
+	// key: lib_name : section_name, value: begin : end
+	// All readable sections form file
+	std::map<std::pair<const std::string, const std::string>, std::pair<uintptr_t, uintptr_t>> m_sections;
+	// executable setion form file, only name is .text .plt .init .init_array .fini .fini_array etc
+	std::map<std::pair<const std::string, const std::string>, std::pair<uintptr_t, uintptr_t>> m_executable_sections;
+
+	// memory segment
+	// key: lib_name : id, value: begin : end
+	// All readable segments form memory
+	std::map<std::pair<const std::string, uint16_t>, std::pair<uintptr_t, uintptr_t>> m_segments;
+	// executable segment form memory, only type is PF_R or PF_X and flags is PT_LOAD
+	std::map<std::pair<const std::string, uint16_t>, std::pair<uintptr_t, uintptr_t>> m_executable_segments;
+	
+	// library name (path) or process_name
+	std::string m_name;
+
+	// sections of one module, parsed by a worker
+	struct parsed_sections
+	{
+		std::map<std::pair<const std::string, const std::string>, std::pair<uintptr_t, uintptr_t>> sections;
+		std::map<std::pair<const std::string, const std::string>, std::pair<uintptr_t, uintptr_t>> executable_sections;
+	};
+
+	// key: lib_name : load bias, dropped when a module is loaded or unloaded
+	struct parsed_cache
+	{
+		std::mutex mutex;
+		uint64_t generation = 0;
+		std::map<std::pair<std::string, uintptr_t>, std::shared_ptr<const parsed_sections>> modules;
+	};
+
+	static parsed_cache& getParsedCache()
+	{
+		static parsed_cache cache;
+		return cache;
+	}
+
+	// modules collected in the dl_iterate_phdr callback, their section headers are parsed outside of it (loader lock)
+	std::vector<loaded_module> m_modules;
+	std::vector<std::shared_ptr<const parsed_sections>> m_parsed;
+	std::vector<std::promise<void>> m_parsedReady;
+	std::vector<std::shared_future<void>> m_parsedFutures;
+	uint64_t m_generation = 0;
+	bool m_merged = true;
+	bool m_findProcess = false;
+#if PATTERNS_USE_TRACE
+	uint64_t m_tracePattern = 0;
+#endif
+
+	static bool ExplainElfSection(const std::string& process_name, const loaded_module& module, parsed_sections& result)
+	{
+		int fd = open(module.name.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd == -1)
+		{
+			PATTERNS_LOGES("Explain elf file: open file failed: %s", module.name.c_str());
+			return false;
+		}
+		off_t fsize = lseek(fd, 0, SEEK_END);
+		if (fsize <= 0)
+		{
+			PATTERNS_LOGES("Explain elf file: get file size failed: %s", module.name.c_str());
+			close(fd);
+			return false;
+		}
+		void* fdata = mmap(nullptr, fsize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (fdata == MAP_FAILED)
+		{
+			PATTERNS_LOGES("Explain elf file: mmap failed: %d - %s", errno, strerror(errno));
+			return false;
+		}
+		Elf_ehdr* ehdr = reinterpret_cast<Elf_ehdr*>(fdata);
+		if (ehdr->e_ident[EI_MAG0] != 0x7F || ehdr->e_ident[EI_MAG1] != 'E' || ehdr->e_ident[EI_MAG2] != 'L' || ehdr->e_ident[EI_MAG3] != 'F')
+		{
+			PATTERNS_LOGES("Explain elf file: this is not an ELF file: %s", module.name.c_str());
+			munmap(fdata, fsize);
+			return false;
+		}
+
+		// the results are copies, the file is not needed after the parse
+		std::unique_ptr<void, std::function<void(void*)>> unmap(fdata, [fsize](void* data) { munmap(data, fsize); });
+
+		elf_shdr* shdr = reinterpret_cast<elf_shdr*>(((uintptr_t)ehdr) + ehdr->e_shoff);
+		uintptr_t shdr_addr = (uintptr_t)shdr;
+		char* shstrtab = reinterpret_cast<char*>((uintptr_t)ehdr + shdr[ehdr->e_shstrndx].sh_offset);
+
+		for (int i = 0; i < ehdr->e_shnum; i++, shdr_addr += ehdr->e_shentsize)
+		{
+			elf_shdr* sec_info = reinterpret_cast<elf_shdr*>(shdr_addr);
+
+			std::string name = shstrtab + sec_info->sh_name;
+			if (sec_info->sh_type == SHT_PROGBITS && sec_info->sh_flags == (SHF_ALLOC | SHF_EXECINSTR))
+			{
+				result.executable_sections.emplace(std::make_pair(module.name, name), 
+					std::make_pair(module.base + sec_info->sh_addr, module.base + sec_info->sh_addr + sec_info->sh_size));
+				PATTERNS_LOGIS("Explain elf file: executable section: process_name: %s, lib_name: %s, lib_base: " PATTERNS_ADDR_FMT "", process_name.c_str(), module.name.c_str(), module.base);
+				PATTERNS_LOGIS("section info: section_name: %s, section_start: " PATTERNS_ADDR_FMT ", section_end: " PATTERNS_ADDR_FMT "", name.c_str(), (uintptr_t)(module.base + sec_info->sh_addr), (uintptr_t)(module.base + sec_info->sh_addr + sec_info->sh_size));
+			}
+			if (sec_info->sh_addr == 0 && name.empty()) // .elf_head
+			{
+				name = ".elf_head";
+				sec_info->sh_size = ehdr->e_ehsize;
+			}
+			result.sections.emplace(std::make_pair(module.name, name), 
+				std::make_pair(module.base + sec_info->sh_addr, module.base + sec_info->sh_addr + sec_info->sh_size));
+			PATTERNS_LOGIS("Explain elf file: section: process_name: %s, lib_name: %s, lib_base: " PATTERNS_ADDR_FMT "", process_name.c_str(), module.name.c_str(), module.base);
+			PATTERNS_LOGIS("section info: section_name: %s, section_start: " PATTERNS_ADDR_FMT ", section_end: " PATTERNS_ADDR_FMT "", name.c_str(), (uintptr_t)(module.base + sec_info->sh_addr), (uintptr_t)(module.base + sec_info->sh_addr + sec_info->sh_size));
+		}
+
+		return true;
+	}
+
+	void ExplainElfSegment(const loaded_module& module)
+	{
+		for (size_t j = 0; j < module.phdrs.size(); j++)
+		{
+			const elf_phdr& phdr = module.phdrs[j];
+			if (phdr.p_type == PT_LOAD && phdr.p_flags == (PF_R | PF_X))
+			{
+				m_executable_segments.emplace(std::make_pair(module.name, j), 
+					std::make_pair(module.base + phdr.p_vaddr, module.base + phdr.p_vaddr + phdr.p_memsz));
+				PATTERNS_LOGIS("Explain elf file: executable segment: process_name: %s, lib_name: %s, lib_base: " PATTERNS_ADDR_FMT "", 
+					m_name.c_str(), module.name.c_str(), module.base);
+				PATTERNS_LOGIS("segment info: id: %zu, segment_start: " PATTERNS_ADDR_FMT ", segment_end: " PATTERNS_ADDR_FMT "", 
+					j, (uintptr_t)(module.base + phdr.p_vaddr), (uintptr_t)(module.base + phdr.p_vaddr + phdr.p_memsz));
+			}
+			m_segments.emplace(std::make_pair(module.name, j), 
+				std::make_pair(module.base + phdr.p_vaddr, module.base + phdr.p_vaddr + phdr.p_memsz));
+			PATTERNS_LOGIS("Explain elf file: segment: process_name: %s, lib_name: %s, lib_base: " PATTERNS_ADDR_FMT "", 
+				m_name.c_str(), module.name.c_str(), module.base);
+			PATTERNS_LOGIS("segment info: id: %zu, segment_start: " PATTERNS_ADDR_FMT ", segment_end: " PATTERNS_ADDR_FMT "", 
+				j, (uintptr_t)(module.base + phdr.p_vaddr), (uintptr_t)(module.base + phdr.p_vaddr + phdr.p_memsz));
+		}
+	}
+
+	// module i is always marked ready, a failed or throwing parse leaves it without sections
+	void ParseModule(size_t i)
+	{
+		static const std::string process_name = details::get_process_name();
+		PATTERNS_TRACE_PATTERN(m_tracePattern);
+		PATTERNS_TRACE("elf parse", m_modules[i].base);
+		try
+		{
+			auto parsed = std::make_shared<parsed_sections>();
+			if (!ExplainElfSection(process_name, m_modules[i], *parsed))
+			{
+				PATTERNS_LOGWS("Explain Elf files failed: %s", m_modules[i].name.c_str());
+			}
+
+			auto& cache = getParsedCache();
+			std::lock_guard<std::mutex> lock(cache.mutex);
+			if (cache.generation == m_generation)
+			{
+				cache.modules[std::make_pair(m_modules[i].name, m_modules[i].base)] = parsed;
+			}
+			m_parsed[i] = std::move(parsed);
+		}
+		catch (const std::exception& error)
+		{
+			PATTERNS_LOGES("Explain Elf files failed: %s: %s", m_modules[i].name.c_str(), error.what());
+		}
+		catch (...)
+		{
+			PATTERNS_LOGES("Explain Elf files failed: %s", m_modules[i].name.c_str());
+		}
+		m_parsedReady[i].set_value();
+	}
+
+	// wait for the workers and merge the parsed sections
+	void WaitSections()
+	{
+		if (m_merged)
+		{
+			return;
+		}
+		for (size_t i = 0; i < m_parsed.size(); i++)
+		{
+			m_parsedFutures[i].wait();
+			m_sections.insert(m_parsed[i]->sections.begin(), m_parsed[i]->sections.end());
+			m_executable_sections.insert(m_parsed[i]->executable_sections.begin(), m_parsed[i]->executable_sections.end());
+		}
+		m_parsed.clear();
+		m_merged = true;
+	}
+
+	void FindLibrarys()
+	{
+		m_name = (m_name.empty() ? details::get_process_name() : m_name);
+		if (m_name.empty())
+		{
+			return;
+		}
+
+		static const std::string process_name = details::get_process_name();
+		static const std::vector<std::string> process_librarys = get_process_librarys();
+
+		// only collect here, dl_iterate_phdr holds the loader lock
+		m_findProcess = (m_name == process_name);
+#if PATTERNS_USE_TRACE
+		m_tracePattern = tracer::currentPattern;
+#endif
+		{
+			PATTERNS_TRACE("module enumeration");
+			PATTERNS_DL_ITERATE_PHDR([](struct dl_phdr_info* info, size_t size, void* data) -> int
+				{
+					executable_meta* self = reinterpret_cast<executable_meta*>(data);
+					if (info->dlpi_name == nullptr || info->dlpi_phdr == nullptr)
+					{
+						return 0;
+					}
+
+					bool found = false;
+					if (self->m_findProcess) // = process name
+					{
+						// lib_name: xxx.so 
+						// info->dlpi_name: /.../.../xxx.so
+						if (strstr(info->dlpi_name, process_name.c_str()))
+						{
+							for (auto& library : process_librarys)
+							{
+								if (strstr(info->dlpi_name, library.c_str()))
+								{
+									found = true;
+									break;
+								}
+							}
+						}
+					}
+					else // = library name(path)
+					{
+						found = strstr(info->dlpi_name, self->m_name.c_str()) != nullptr;
+					}
+
+					if (found)
+					{
+						self->m_modules.emplace_back();
+						loaded_module& module = self->m_modules.back();
+						module.name = info->dlpi_name;
+						module.base = info->dlpi_addr;
+						module.phdrs.assign(info->dlpi_phdr, info->dlpi_phdr + info->dlpi_phnum);
+					}
+					return (found && !self->m_findProcess) ? 1 : 0; // a library name stops at the first module
+				}, this);
+
+			for (auto& module : m_modules)
+			{
+				ExplainElfSegment(module);
+			}
+		}
+
+		// sections: cached per module, the rest is parsed on the shared pool,
+		// scanning of a module can start as soon as its headers are ready
+		static const auto empty = std::make_shared<const parsed_sections>();
+		m_parsed.assign(m_modules.size(), empty);
+		m_parsedReady.resize(m_modules.size());
+		for (auto& ready : m_parsedReady)
+		{
+			m_parsedFutures.emplace_back(ready.get_future().share());
+		}
+		m_merged = false;
+		m_generation = GetModuleGeneration();
+
+		std::vector<size_t> missing;
+		{
+			auto& cache = getParsedCache();
+			std::lock_guard<std::mutex> lock(cache.mutex);
+			if (cache.generation != m_generation)
+			{
+				cache.modules.clear();
+				cache.generation = m_generation;
+			}
+			for (size_t i = 0; i < m_modules.size(); i++)
+			{
+				auto it = cache.modules.find(std::make_pair(m_modules[i].name, m_modules[i].base));
+				if (it != cache.modules.end())
+				{
+					m_parsed[i] = it->second;
+					m_parsedReady[i].set_value();
+				}
+				else
+				{
+					missing.push_back(i);
+				}
+			}
+		}
+
+		if (missing.size() <= 1 || parse_pool::Size() <= 1)
+		{
+			for (size_t i : missing)
+			{
+				ParseModule(i);
+			}
+			return;
+		}
+		for (size_t i : missing)
+		{
+			parse_pool::Get().Submit([this, i]() { ParseModule(i); });
+		}
+	}
+
+	explicit executable_meta(const std::string& lib_name)
+		: m_name(lib_name)
+	{
+	}
+
+public:
+	void Initialize(uintptr_t begin)
+	{
+		if (m_name.empty())
+		{
+			PATTERNS_DL_ADDR(begin, info);
+			if (info.dli_fbase == nullptr)
+			{
+				return;
+			}
+			if (info.dli_fname != nullptr)
+			{
+				m_name = info.dli_fname;
+			}
+			PATTERNS_DL_ADDR_CLEAN;
+		}
+		
+		FindLibrarys();
+		WaitSections();
+
+		if (!m_sections.empty())
+		{
+			for (auto& section : m_sections)
+			{
+				if (section.second.first <= begin && begin < section.second.second)
+				{
+					uintptr_t end = section.second.second;
+					std::pair<const std::string, const std::string> name = section.first;
+					m_sections.clear();
+					m_sections.emplace(name, std::make_pair(begin, end));
+					m_executable_sections.clear();
+					m_executable_sections.emplace(name, std::make_pair(begin, end));
+
+					PATTERNS_LOGIS("executable_meta::Initialize: lib_name: %s, section_name: %s, begin: " PATTERNS_ADDR_FMT ", end: " PATTERNS_ADDR_FMT "", 
+						name.first.c_str(), name.second.c_str(), begin, end);
+					break;
+				}
+			}
+		}
+		if (!m_segments.empty())
+		{
+			for (auto& segment : m_segments)
+			{
+				if (segment.second.first <= begin && begin < segment.second.second)
+				{
+					uintptr_t end = segment.second.second;
+					std::pair<const std::string, uint16_t> name = segment.first;
+					m_segments.clear();
+					m_segments.emplace(name, std::make_pair(begin, end));
+					m_executable_segments.clear();
+					m_executable_segments.emplace(name, std::make_pair(begin, end));
+
+					PATTERNS_LOGIS("executable_meta::Initialize: lib_name: %s, segment_id: %d, begin: " PATTERNS_ADDR_FMT ", end: " PATTERNS_ADDR_FMT "", 
+						name.first.c_str(), name.second, begin, end);
+					break;
+				}
+			}
+		}
+	}
+
+	void Initialize(uintptr_t begin, uintptr_t end)
+	{
+		PATTERNS_LOGIS("executable_meta::Initialize: name: %s, begin: " PATTERNS_ADDR_FMT ", end: " PATTERNS_ADDR_FMT "", m_name.c_str(), begin, end);
+		
+		if (begin >= end && begin != 0u && end != 0u)
+		{
+			PATTERNS_LOGE("executable_meta::Initialize: begin >= end");
+			return;
+		}
+		if (begin == 0u && end == 0u)
+		{
+			PATTERNS_LOGW("executable_meta::Initialize: begin and end is 0. find all segments or sections in the process by default.");
+			FindLibrarys();
+			return;
+		}
+		if (end == 0u)
+		{
+			Initialize(begin);
+			return;
+		}
+		if (begin == 0)
+		{
+			if (m_name.empty())
+			{
+				PATTERNS_DL_ADDR(end, info);
+				if (info.dli_fbase == nullptr)
+				{
+					return;
+				}
+				if (info.dli_fname != nullptr)
+				{
+					m_name = info.dli_fname;
+				}
+				PATTERNS_DL_ADDR_CLEAN;
+			}
+			
+			FindLibrarys();
+			WaitSections();
+
+			if (!m_sections.empty())
+			{
+				for (auto& section : m_sections)
+				{
+					if (section.second.first < end && end <= section.second.second)
+					{
+						begin = section.second.first;
+						std::pair<const std::string, const std::string> name = section.first;
+						m_sections.clear();
+						m_sections.emplace(name, std::make_pair(begin, end));
+						m_executable_sections.clear();
+						m_executable_sections.emplace(name, std::make_pair(begin, end));
+
+						PATTERNS_LOGIS("executable_meta::Initialize: lib_name: %s, section_name: %s, begin: " PATTERNS_ADDR_FMT ", end: " PATTERNS_ADDR_FMT "", 
+							name.first.c_str(), name.second.c_str(), begin, end);
+						break;
+					}
+				}
+			}
+			if (!m_segments.empty())
+			{
+				for (auto& segment : m_segments)
+				{
+					if (segment.second.first < end && end <= segment.second.second)
+					{
+						begin = segment.second.first;
+						std::pair<const std::string, uint16_t> name = segment.first;
+						m_segments.clear();
+						m_segments.emplace(name, std::make_pair(begin, end));
+						m_executable_segments.clear();
+						m_executable_segments.emplace(name, std::make_pair(begin, end));
+
+						PATTERNS_LOGIS("executable_meta::Initialize: lib_name: %s, segment_id: %d, begin: " PATTERNS_ADDR_FMT ", end: " PATTERNS_ADDR_FMT "", 
+							name.first.c_str(), name.second, begin, end);
+						break;
+					}
+				}
+			}
+			return;
+		}
+
+		std::pair<std::string, std::string> section_name;
+		std::pair<std::string, uint16_t> segment_name;
+		if (!m_name.empty())
+		{
+			FindLibrarys();
+			WaitSections();
+
+			if (!m_sections.empty())
+			{
+				for (auto& section : m_sections)
+				{
+					if (section.second.first <= begin && end <= section.second.second)
+					{
+						section_name = section.first;
+						break;
+					}
+				}
+			}
+
+			if (!m_segments.empty())
+			{
+				for (auto& segment : m_segments)
+				{
+					if (segment.second.first <= begin && end <= segment.second.second)
+					{
+						segment_name = segment.first;
+						goto end;
+					}
+				}
+			}
+			PATTERNS_LOGE("executable_meta: begin and end is not in the same segment or section.");
+			return;
+		}
+	end:
+		m_sections.clear();
+		m_sections.emplace(section_name, std::make_pair(begin, end));
+		m_executable_sections.clear();
+		m_executable_sections.emplace(section_name, std::make_pair(begin, end));
+		m_segments.clear();
+		m_segments.emplace(segment_name, std::make_pair(begin, end));
+		m_executable_segments.clear();
+		m_executable_segments.emplace(segment_name, std::make_pair(begin, end));
+	}
+
+	executable_meta(uintptr_t begin, uintptr_t end, const std::string& lib_name)
+		: executable_meta(lib_name)
+	{
+		Initialize(begin, end);
+	}
+
+	~executable_meta()
+	{
+		WaitSections();
+		m_name.clear();
+		m_sections.clear();
+		m_executable_sections.clear();
+		m_segments.clear();
+		m_executable_segments.clear();
+	}
+
+	inline const std::map<std::pair<const std::string, const std::string>, std::pair<uintptr_t, uintptr_t>>& get_sections(bool is_executable)
+	{
+		WaitSections();
+		return is_executable ? m_executable_sections : m_sections;
+	}
+
+	// sections per module in load order, each module is handed out as soon as its headers are parsed,
+	// the callback returns true to stop
+	template<typename Callback>
+	inline void for_each_sections(bool is_executable, Callback&& callback)
+	{
+		if (m_merged)
+		{
+			callback(is_executable ? m_executable_sections : m_sections);
+			return;
+		}
+		for (size_t i = 0; i < m_parsed.size(); i++)
+		{
+			m_parsedFutures[i].wait();
+			if (callback(is_executable ? m_parsed[i]->executable_sections : m_parsed[i]->sections))
+			{
+				break;
+			}
+		}
+	}
+
+	inline const std::map<std::pair<const std::string, uint16_t>, std::pair<uintptr_t, uintptr_t>>& get_segments(bool is_executable)
+	{
+		return is_executable ? m_executable_segments : m_segments;
+	}
+};
+
+#if PATTERNS_USE_STATS
+// call sites by file, line, tag and pattern text
+using call_site_key = std::tuple<std::string, uint32_t, std::string, std::string>;
+
+static auto& getStatsRegistry()
+{
+	static std::map<call_site_key, call_site_stats> registry;
+	return registry;
+}
+
+static std::mutex& getStatsMutex()
+{
+	static std::mutex mutex;
+	return mutex;
+}
+
+static std::string& getCurrentTag()
+{
+	static thread_local std::string tag;
+	return tag;
+}
+
+pattern_tag::pattern_tag(std::string tag)
+	: m_previous(std::move(getCurrentTag()))
+{
+	getCurrentTag() = std::move(tag);
+}
+
+pattern_tag::~pattern_tag()
+{
+	getCurrentTag() = std::move(m_previous);
+}
+
+static void AddStats(pattern_stats& total, const pattern_stats& stats)
+{
+	total.bytes_scanned += stats.bytes_scanned;
+	total.ranges_visited += stats.ranges_visited;
+	total.candidates += stats.candidates;
+	total.matches += stats.matches;
+	total.hint_hits += stats.hint_hits;
+	total.hint_misses += stats.hint_misses;
+	total.metadata_ns += stats.metadata_ns;
+	total.hint_ns += stats.hint_ns;
+	total.scan_ns += stats.scan_ns;
+}
+
+static uint64_t Cost(const pattern_stats& stats)
+{
+	return stats.metadata_ns + stats.hint_ns + stats.scan_ns;
+}
+
+pattern_stats get_pattern_stats()
+{
+	std::lock_guard<std::mutex> lock(getStatsMutex());
+
+	pattern_stats total{};
+	for (auto& entry : getStatsRegistry())
+	{
+		AddStats(total, entry.second.stats);
+	}
+	return total;
+}
+
+std::vector<call_site_stats> get_call_site_stats()
+{
+	std::vector<call_site_stats> sites;
+	{
+		std::lock_guard<std::mutex> lock(getStatsMutex());
+
+		sites.reserve(getStatsRegistry().size());
+		for (auto& entry : getStatsRegistry())
+		{
+			sites.emplace_back(entry.second);
+		}
+	}
+
+	std::stable_sort(sites.begin(), sites.end(), [](const call_site_stats& left, const call_site_stats& right) { return Cost(left.stats) > Cost(right.stats); });
+	return sites;
+}
+
+std::string dump_pattern_stats(size_t top)
+{
+	std::vector<call_site_stats> sites = get_call_site_stats();
+	sites.resize(std::min(top, sites.size()));
+
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(3);
+	for (auto& site : sites)
+	{
+		const pattern_stats& stats = site.stats;
+
+		const char* name = strrchr(site.file.c_str(), '/');
+		out << Cost(stats) / 1e6 << " ms"
+			<< " calls " << site.calls
+			<< " metadata " << stats.metadata_ns / 1e6 << " ms"
+			<< " hint " << stats.hint_ns / 1e6 << " ms"
+			<< " scan " << stats.scan_ns / 1e6 << " ms"
+			<< " bytes " << stats.bytes_scanned
+			<< " ranges " << stats.ranges_visited
+			<< " candidates " << stats.candidates
+			<< " matches " << stats.matches
+			<< " hints " << stats.hint_hits << "/" << stats.hint_misses
+			<< " " << (name ? name + 1 : site.file.c_str()) << ":" << site.line;
+		if (!site.tag.empty())
+		{
+			out << " [" << site.tag << "]";
+		}
+		out << " " << site.lib_name << " \"" << site.pattern << "\"\n";
+	}
+	return out.str();
+}
+
+// RFC 4180 field
+static std::string CsvField(const std::string& value)
+{
+	if (value.find_first_of(",\"\r\n") == std::string::npos)
+	{
+		return value;
+	}
+
+	std::string quoted = "\"";
+	for (char c : value)
+	{
+		quoted += c;
+		if (c == '"')
+		{
+			quoted += c;
+		}
+	}
+	return quoted + "\"";
+}
+
+std::string dump_call_site_csv(const std::string& path)
+{
+	std::ostringstream out;
+	out << "file,line,tag,pattern,library,calls,total_ns,metadata_ns,hint_ns,scan_ns,bytes_scanned,ranges_visited,candidates,matches,hint_hits,hint_misses\n";
+	for (auto& site : get_call_site_stats())
+	{
+		const pattern_stats& stats = site.stats;
+		out << CsvField(site.file) << "," << site.line << "," << CsvField(site.tag) << "," << CsvField(site.pattern) << "," << CsvField(site.lib_name)
+			<< "," << site.calls << "," << Cost(stats) << "," << stats.metadata_ns << "," << stats.hint_ns << "," << stats.scan_ns
+			<< "," << stats.bytes_scanned << "," << stats.ranges_visited << "," << stats.candidates << "," << stats.matches
+			<< "," << stats.hint_hits << "," << stats.hint_misses << "\n";
+	}
+
+	if (!path.empty())
+	{
+		std::ofstream fp(path, std::ios::trunc);
+		if (!fp || !(fp << out.str()))
+		{
+			PATTERNS_LOGES("dump_call_site_csv: write %s failed", path.c_str());
+		}
+	}
+	return out.str();
+}
+#endif
+
+namespace details
+{
+
+void basic_pattern_impl::Initialize(std::string_view pattern, [[maybe_unused]] pattern_location location)
+{
+	// get the hash for the base pattern
+#if PATTERNS_USE_HINTS
+	m_hash = fnv_1()(pattern);
+#endif
+
+#if PATTERNS_USE_TRACE
+	m_traceId = tracer::RegisterPattern(pattern);
+#endif
+	PATTERNS_TRACE_PATTERN(m_traceId);
+
+#if PATTERNS_USE_STATS
+	m_source = pattern;
+	SetLocation(location);
+#endif
+
+	// transform the base pattern from IDA format to canonical format
+	std::vector<pattern_capture> captures;
+	TransformPattern(pattern, m_bytes, m_mask, &m_gaps, &m_classes, &captures);
+	if (m_mask.empty())
+	{
+		// rejected, drop what was parsed before the error
+		m_gaps.clear();
+		m_classes.clear();
+	}
+	else if (!captures.empty())
+	{
+		m_captures = std::make_shared<const std::vector<pattern_capture>>(std::move(captures));
+	}
+
+#if PATTERNS_USE_HINTS
+	// if there's hints, try those first
+	// heap and JIT addresses do not last, memory source patterns have no hints
+#if PATTERNS_CAN_SERIALIZE_HINTS
+	if (m_rangeStart == get_process_base(m_libName) && m_memorySources.kinds == 0)
+#else
+	if (m_memorySources.kinds == 0)
+#endif
+	{
+		PATTERNS_TRACE("hint lookup");
+#if PATTERNS_USE_STATS
+		auto started = std::chrono::steady_clock::now();
+#endif
+		auto range = getHints().equal_range(m_hash);
+		std::vector<uintptr_t> hinted;
+		std::for_each(range.first, range.second, [&] (const auto& hint) { hinted.emplace_back(hint.second); });
+
+#if PATTERNS_CAN_SERIALIZE_HINTS
+		// saved by an earlier run, the module may be loaded somewhere else now
+		auto saved = getModuleHints().equal_range(m_hash);
+		std::for_each(saved.first, saved.second, [&] (const auto& hint)
+		{
+			const uintptr_t address = RebaseHint(hint.second);
+			if (address != 0 && std::find(hinted.begin(), hinted.end(), address) == hinted.end())
+			{
+				hinted.emplace_back(address);
+			}
+		});
+#endif
+
+		if (!hinted.empty())
+		{
+			std::for_each(hinted.begin(), hinted.end(), [&] (uintptr_t hint)
+			{
+				if (!ConsiderHint(hint))
+				{
+					PATTERNS_STATS(m_stats.hint_misses++);
+#if PATTERNS_CAN_SERIALIZE_HINTS
+					m_staleHints.emplace_back(hint);
+#endif
+				}
+				else
+				{
+					PATTERNS_STATS(m_stats.hint_hits++);
+				}
+			});
+			PATTERNS_STATS(m_stats.hint_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count());
+
+			// if the hints succeeded, we don't need to do anything more
+			if (!m_matches.empty())
+			{
+#if PATTERNS_CAN_SERIALIZE_HINTS
+				m_staleHints.clear();
+#endif
+#if PATTERNS_USE_STATS
+				m_stats.matches = m_matches.size();
+				RecordStats();
+#endif
+				m_matched = true;
+				return;
+			}
+		}
+	}
+#endif
+}
+
+void basic_pattern_impl::EnsureMatches(uint32_t maxCount)
+{
+	if (m_matched || (!m_rangeStart && !m_rangeEnd && m_libName.empty() && m_memorySources.kinds == 0))
+	{
+		return;
+	}
+
+	PATTERNS_TRACE_PATTERN(m_traceId);
+	PATTERNS_TRACE("resolve");
+
+	if (m_incremental && !m_dirtyWatch)
+	{
+		m_dirtyWatch = dirty_tracker::Create();
+	}
+	if (m_dirtyWatch)
+	{
+		dirty_tracker::Begin();
+	}
+
+#if PATTERNS_USE_STATS
+	auto started = std::chrono::steady_clock::now();
+	auto elapsed = [](std::chrono::steady_clock::time_point since) -> uint64_t
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count();
+	};
+#endif
+
+#if PATTERNS_USE_HINTS && PATTERNS_CAN_SERIALIZE_HINTS
+	// the hints are stale: search around them before the full scan
+	if (m_hintProximity && m_maxMismatches == 0 && m_align == 1 && !m_functionStart && !m_staleHints.empty() && ConsiderProximity())
+	{
+#if PATTERNS_USE_STATS
+		m_stats.matches = m_matches.size();
+		m_stats.hint_ns += elapsed(started);
+		RecordStats();
+#endif
+		m_matched = true;
+		return;
+	}
+#endif
+
+	// scan the executable for code
+	PATTERNS_TRACE_BEGIN(planning, "scan plan");
+	std::unique_ptr<executable_meta> executable;
+	if (m_memorySources.kinds == 0)
+	{
+		executable = std::make_unique<executable_meta>(m_rangeStart, m_rangeEnd, m_libName);
+	}
+	PATTERNS_TRACE_END(planning);
+
+#if PATTERNS_USE_STATS
+	// sections parsed by the workers after this point are waited for inside the scan
+	m_stats.metadata_ns += elapsed(started);
+	auto scanStarted = std::chrono::steady_clock::now();
+#endif
+
+	auto matchSuccess = [&](uintptr_t address)
+	{
+#if PATTERNS_USE_HINTS
+		// the hints are looked up by the pattern alone, approximate, aligned and function start matches stay out of them
+		if (m_maxMismatches == 0 && m_align == 1 && !m_functionStart && m_memorySources.kinds == 0)
+		{
+			getHints().emplace(m_hash, address);
+		}
+#else
+		(void)address;
+#endif
+
+		return (m_matches.size() >= maxCount);
+	};
+
+	const pattern_scanner scanner(m_bytes, m_mask, m_gaps, m_classes, m_maxMismatches);
+	const size_t maskSize = scanner.size();
+
+	// memory sources are freed and remapped under the scan, they are always copied; the copies are private memory,
+	// allocated before the sources are listed so a scan over them never finds its own buffer
+	const bool copied = m_safeRead || m_memorySources.kinds != 0;
+	private_vector<uint8_t> copyBuffer(copied ? std::max<size_t>(0x10000, maskSize) + maskSize : 0);
+
+	// a gapped match may be reported again by an overlapping buffer or a second anchor position
+	std::unordered_set<uintptr_t> gappedMatches;
+	for (size_t i = 0; scanner.gapped() && i < m_matches.size(); i++)
+	{
+		gappedMatches.insert(reinterpret_cast<uintptr_t>(m_matches[i].get<void>()));
+	}
+
+	// candidate alignment of the range being scanned, 0: derived from the module's e_machine
+	size_t align = 1;
+
+	// deadline and cancellation, checked every chunk; resumeAt is the first untested address
+	const bool bounded = m_cancelled || m_deadline != std::chrono::steady_clock::time_point::max();
+	bool interrupted = false;
+	auto Interrupt = [&](uintptr_t resumeAt) -> bool
+	{
+		if ((m_cancelled && m_cancelled->load(std::memory_order_relaxed)) || std::chrono::steady_clock::now() >= m_deadline)
+		{
+			interrupted = true;
+			m_progress.resume_address = resumeAt;
+		}
+		return interrupted;
+	};
+
+	// scan a buffer which mirrors the memory at address, returns true once maxCount is reached or the scan is interrupted
+	auto MatchesBuffer = [&](const uint8_t* data, size_t size, uintptr_t address) -> bool
+	{
+		auto Found = [&](uintptr_t found)
+		{
+			if (scanner.gapped() && !gappedMatches.insert(found).second)
+			{
+				return false;
+			}
+			const uint8_t* ptr = data + (found - address);
+			AddMatch(found, ptr, scanner.maxMismatches() ? scanner.Mismatches(ptr) : 0);
+			return matchSuccess(found);
+		};
+
+		if (!bounded)
+		{
+			return scanner.Scan(data, size, address, Found, align);
+		}
+
+		// chunks of candidate positions, each reading up to maskSize - 1 bytes into the next one
+		const size_t chunkSize = 0x40000;
+		for (size_t offset = 0; offset < size; offset += chunkSize)
+		{
+			if (Interrupt(address + offset))
+			{
+				return true;
+			}
+			if (scanner.Scan(data + offset, std::min(size - offset, chunkSize + maskSize - 1), address + offset, Found, align))
+			{
+				return true;
+			}
+		}
+		return false;
+	};
+
+	// copy the range through process_vm_readv in chunks, unreadable pages are skipped instead of faulting
+	auto MatchesCopied = [&](uintptr_t begin, uintptr_t end) -> bool
+	{
+		static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		const size_t chunkSize = std::max<size_t>(0x10000, maskSize);
+
+		auto& buffer = copyBuffer;
+		uintptr_t address = begin; // address of buffer[0]
+		size_t used = 0;
+		for (uintptr_t cursor = begin; cursor < end;)
+		{
+			size_t want = std::min<size_t>(chunkSize, end - cursor);
+			size_t read = memory_maps::ReadSelf(buffer.data() + used, cursor, want);
+			used += read;
+
+			if (MatchesBuffer(buffer.data(), used, address))
+			{
+				return true;
+			}
+
+			if (read < want)
+			{
+				// skip the faulting page and restart the run behind it
+				cursor = ((cursor + read) & ~(pageSize - 1)) + pageSize;
+				address = cursor;
+				used = 0;
+				continue;
+			}
+
+			// keep the tail which was too short to be tested
+			cursor += read;
+			size_t keep = std::min(used, maskSize - 1);
+			memmove(buffer.data(), buffer.data() + used - keep, keep);
+			address += used - keep;
+			used = keep;
+		}
+		return false;
+	};
+
+	// residency-aware order: pages already in memory first, then the cold pages with madvise(MADV_WILLNEED) running ahead
+	auto MatchesResident = [&](uintptr_t begin, uintptr_t end) -> bool
+	{
+		static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		const uintptr_t first = begin & ~(pageSize - 1);
+		const size_t pageCount = (end - first + pageSize - 1) / pageSize;
+
+		std::vector<unsigned char> residency(pageCount);
+		if (end - begin < maskSize || mincore(reinterpret_cast<void*>(first), end - first, residency.data()) != 0)
+		{
+			return MatchesBuffer(reinterpret_cast<const uint8_t*>(begin), end - begin, begin);
+		}
+
+		// runs of pages with the same residency, a run reads up to maskSize - 1 bytes into the next one
+		auto PageBegin = [&](size_t page) { return std::max(begin, first + page * pageSize); };
+		auto MatchesRun = [&](size_t page, size_t pageEnd) -> bool
+		{
+			uintptr_t runBegin = PageBegin(page), runEnd = std::min(end, first + pageEnd * pageSize);
+			size_t size = std::min<uintptr_t>(runEnd - runBegin + maskSize - 1, end - runBegin);
+			return MatchesBuffer(reinterpret_cast<const uint8_t*>(runBegin), size, runBegin);
+		};
+
+		std::vector<std::pair<size_t, size_t>> coldRuns;
+		for (size_t page = 0; page < pageCount;)
+		{
+			size_t pageEnd = page + 1;
+			const bool resident = residency[page] & 1;
+			while (pageEnd < pageCount && (residency[pageEnd] & 1) == resident) pageEnd++;
+
+			if (resident)
+			{
+				getPrefetchCounters().residentPages += pageEnd - page;
+				if (MatchesRun(page, pageEnd))
+				{
+					return true;
+				}
+			}
+			else
+			{
+				coldRuns.emplace_back(page, pageEnd);
+			}
+			page = pageEnd;
+		}
+
+		if (coldRuns.empty())
+		{
+			return false;
+		}
+
+		memory_maps::region region;
+		const bool sequential = m_prefetchSequential && memory_maps::Find(begin, region) && !region.path.empty() && region.path[0] == '/';
+		if (sequential)
+		{
+			madvise(reinterpret_cast<void*>(first), end - first, MADV_SEQUENTIAL);
+		}
+
+		const size_t windowPages = std::max<size_t>(1, 0x10000 / pageSize);
+		const size_t distancePages = std::max<size_t>(1, m_prefetchDistance / pageSize);
+		size_t prefetched = coldRuns.front().first;
+		bool done = false;
+		for (auto run = coldRuns.begin(); run != coldRuns.end() && !done; ++run)
+		{
+			getPrefetchCounters().coldPages += run->second - run->first;
+			for (size_t page = run->first; page < run->second && !done; page += windowPages)
+			{
+				const size_t pageEnd = std::min(run->second, page + windowPages);
+
+				// keep the advice distance pages ahead of the scanner
+				const size_t target = std::min(pageCount, page + distancePages);
+				if (prefetched < target)
+				{
+					prefetched = std::max(prefetched, page);
+					madvise(reinterpret_cast<void*>(first + prefetched * pageSize), (target - prefetched) * pageSize, MADV_WILLNEED);
+					getPrefetchCounters().prefetchedPages += target - prefetched;
+					prefetched = target;
+				}
+
+				unsigned char now[64];
+				const size_t count = std::min<size_t>(pageEnd - page, sizeof(now));
+				if (mincore(reinterpret_cast<void*>(first + page * pageSize), count * pageSize, now) == 0)
+				{
+					getPrefetchCounters().faultsAvoided += std::count_if(now, now + count, [](unsigned char v) { return (v & 1) != 0; });
+				}
+
+				done = MatchesRun(page, pageEnd);
+			}
+		}
+
+		if (sequential)
+		{
+			madvise(reinterpret_cast<void*>(first), end - first, MADV_NORMAL);
+		}
+		return done;
+	};
+
+	// only test the pattern at known function entries (prologue signatures)
+	auto MatchesFunctionStart = [&](uintptr_t begin, uintptr_t end) -> bool
+	{
+		if (end - begin < scanner.minSize())
+		{
+			return false;
+		}
+
+		auto functions = function_index::Get(begin);
+		if (functions->empty())
+		{
+			PATTERNS_LOGWS("MatchesFunctionStart: no function entries, begin: " PATTERNS_ADDR_FMT ", end: " PATTERNS_ADDR_FMT "", begin, end);
+			return false;
+		}
+
+		std::basic_string<uint8_t> copy(copied ? maskSize : 0, 0);
+		size_t tested = 0;
+		for (auto it = std::lower_bound(functions->begin(), functions->end(), begin); it != functions->end() && *it <= end - scanner.minSize(); ++it)
+		{
+			if (bounded && (tested++ & 0xFFF) == 0 && Interrupt(*it))
+			{
+				return true;
+			}
+
+			const uint8_t* ptr = reinterpret_cast<const uint8_t*>(*it);
+			size_t available = std::min<size_t>(maskSize, end - *it);
+			if (copied)
+			{
+				available = memory_maps::ReadSelf(copy.data(), *it, available);
+				ptr = copy.data();
+			}
+			if (scanner.Compare(ptr, available))
+			{
+				AddMatch(*it, ptr, scanner.maxMismatches() ? scanner.Mismatches(ptr) : 0);
+				if (matchSuccess(*it))
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	};
+
+	// only the readable parts of a range are scanned, a guard page or an unmapped hole is a SIGSEGV and not an exception
+	// returns true once maxCount is reached, so no further range needs to be visited
+	auto Matches = [&](uintptr_t begin, uintptr_t end) -> bool
+	{
+		if (m_matches.size() >= maxCount)
+		{
+			return true;
+		}
+
+		PATTERNS_TRACE("range scan", begin, end);
+		align = m_align ? m_align : GetModuleAlignment(begin);
+		for (auto& readable : memory_maps::Readable(begin, end))
+		{
+			// watched from before it is scanned, so a write during the scan is seen by the next rescan
+			if (m_dirtyWatch)
+			{
+				dirty_tracker::Watch(*m_dirtyWatch, readable.first, readable.second, align);
+			}
+
+			// an interrupted resolve continues behind the ranges it finished and inside the one it stopped in
+			if (std::find(m_scannedRanges.begin(), m_scannedRanges.end(), readable.first) != m_scannedRanges.end())
+			{
+				continue;
+			}
+			uintptr_t from = readable.first;
+			if (m_progress.resume_address > readable.first && m_progress.resume_address < readable.second)
+			{
+				from = m_progress.resume_address;
+			}
+			m_progress.resume_address = 0;
+
+			PATTERNS_STATS(m_stats.ranges_visited++);
+
+			bool done = false;
+			if (m_functionStart)
+			{
+				done = MatchesFunctionStart(from, readable.second);
+			}
+			else if (copied)
+			{
+				done = MatchesCopied(from, readable.second);
+			}
+			else if (m_prefetchDistance)
+			{
+				// with a deadline the residency order is kept inside 1 MB slabs, an interrupted scan resumes at the slab
+				const uintptr_t slab = bounded ? 0x100000 : readable.second - from;
+				for (uintptr_t at = from; at < readable.second && !done; at += slab)
+				{
+					done = MatchesResident(at, std::min<uintptr_t>(readable.second, at + slab + maskSize - 1));
+					if (interrupted)
+					{
+						m_progress.resume_address = at;
+						m_matches.erase(std::remove_if(m_matches.begin(), m_matches.end(), [&](const pattern_match& match)
+						{
+							return reinterpret_cast<uintptr_t>(match.get<void>()) >= at && reinterpret_cast<uintptr_t>(match.get<void>()) < at + slab;
+						}), m_matches.end());
+					}
+				}
+			}
+			else
+			{
+				done = MatchesBuffer(reinterpret_cast<const uint8_t*>(from), readable.second - from, from);
+			}
+
+			if (interrupted)
+			{
+				m_progress.bytes_scanned += m_progress.resume_address - from;
+				PATTERNS_STATS(m_stats.bytes_scanned += m_progress.resume_address - from);
+				return true;
+			}
+
+			m_progress.bytes_scanned += readable.second - from;
+			PATTERNS_STATS(m_stats.bytes_scanned += readable.second - from);
+			m_progress.ranges_done++;
+			m_scannedRanges.emplace_back(readable.first);
+
+			if (done)
+			{
+				return true;
+			}
+		}
+		return false;
+	};
+
+	// a single match is looked for in the likely ranges first: the module of a stale hint, then .text, then the rest
+	struct scan_range
+	{
+		int rank;
+		uintptr_t begin;
+		uintptr_t end;
+	};
+
+	const bool firstMatch = (maxCount == 1);
+	std::vector<scan_range> plan;
+	std::vector<std::string> hintedLibrarys;
+#if PATTERNS_USE_HINTS && PATTERNS_CAN_SERIALIZE_HINTS
+	if (firstMatch)
+	{
+		for (uintptr_t hint : m_staleHints)
+		{
+			loaded_module module;
+			if (FindLoadedModule(hint, module))
+			{
+				hintedLibrarys.emplace_back(module.name);
+			}
+		}
+	}
+#endif
+
+	auto Rank = [&](const std::string& library, const std::string* section) -> int
+	{
+		if (std::find(hintedLibrarys.begin(), hintedLibrarys.end(), library) != hintedLibrarys.end())
+		{
+			return 0;
+		}
+		return (section != nullptr && *section == ".text") ? 1 : 2;
+	};
+
+	if (m_memorySources.kinds != 0)
+	{
+		// the pattern's own bytes are on the heap as well
+		auto own = scanner.storage();
+		own.emplace_back(reinterpret_cast<uintptr_t>(m_bytes.data()), reinterpret_cast<uintptr_t>(m_bytes.data() + m_bytes.size()));
+		own.emplace_back(reinterpret_cast<uintptr_t>(m_mask.data()), reinterpret_cast<uintptr_t>(m_mask.data() + m_mask.size()));
+		for (auto& range : memory_maps::Sources(m_memorySources, own))
+		{
+			if (Matches(range.first, range.second))
+			{
+				break;
+			}
+		}
+	}
+	else if (m_findSection)
+	{
+		executable->for_each_sections(m_findExecutable, [&](const auto& sections) -> bool
+		{
+			for (auto& section : sections)
+			{
+				if (!Wanted(section.first.first, &section.first.second))
+				{
+					continue;
+				}
+				if (firstMatch)
+				{
+					plan.push_back({ Rank(section.first.first, &section.first.second), section.second.first, section.second.second });
+				}
+				else if (Matches(section.second.first, section.second.second))
+				{
+					return true;
+				}
+			}
+			return false;
+		});
+	}
+	else
+	{
+		auto& segments = executable->get_segments(m_findExecutable);
+		for (auto& segment : segments)
+		{
+			if (!Wanted(segment.first.first, nullptr))
+			{
+				continue;
+			}
+			if (firstMatch)
+			{
+				plan.push_back({ Rank(segment.first.first, nullptr), segment.second.first, segment.second.second });
+			}
+			else if (Matches(segment.second.first, segment.second.second))
+			{
+				break;
+			}
+		}
+	}
+
+	std::stable_sort(plan.begin(), plan.end(), [](const scan_range& left, const scan_range& right) { return left.rank < right.rank; });
+	for (auto& range : plan)
+	{
+		if (Matches(range.begin, range.end))
+		{
+			break;
+		}
+	}
+
+	if (interrupted)
+	{
+		PATTERNS_LOGWS("EnsureMatches: scan interrupted, matches: %zu, ranges done: %zu, resume: " PATTERNS_ADDR_FMT "", m_matches.size(), m_progress.ranges_done, m_progress.resume_address);
+	}
+
+	// residency order does not visit the ranges by address, gapped matches come in anchor order
+	if (m_prefetchDistance || scanner.gapped())
+	{
+		std::sort(m_matches.begin(), m_matches.end(), [](const pattern_match& left, const pattern_match& right) { return left.get<void>() < right.get<void>(); });
+	}
+
+#if PATTERNS_USE_STATS
+	m_stats.candidates += scanner.candidates();
+	m_stats.matches = m_matches.size();
+	m_stats.scan_ns += elapsed(scanStarted);
+	RecordStats();
+#endif
+
+	// an interrupted scan stays unresolved, the next call resumes it
+	m_progress.complete = !interrupted;
+	m_matched = !interrupted;
+	m_scannedAll = !interrupted && m_matches.size() < maxCount;
+}
+
+size_t basic_pattern_impl::Rescan()
+{
+	// the first time, after a scan cut short (count, deadline) or when a watched range was remapped: everything
+	std::vector<std::tuple<size_t, uintptr_t, uintptr_t>> runs;
+	if (!m_incremental || m_functionStart || !m_dirtyWatch || !m_matched || !m_scannedAll || !dirty_tracker::TakeDirty(*m_dirtyWatch, runs))
+	{
+		m_matches.clear();
+		m_matched = false;
+		m_progress = {};
+		m_scannedRanges.clear();
+		m_dirtyWatch.reset();
+		EnsureMatches(UINT32_MAX);
+		return m_matches.size();
+	}
+	if (runs.empty())
+	{
+		return m_matches.size();
+	}
+
+	PATTERNS_TRACE_PATTERN(m_traceId);
+	PATTERNS_TRACE("rescan");
+
+	const pattern_scanner scanner(m_bytes, m_mask, m_gaps, m_classes, m_maxMismatches);
+	const size_t span = scanner.size();
+
+	// a match overlapping a written page is dropped, the starts which can reach it are scanned again
+	struct window
+	{
+		uintptr_t first; // the starts to test
+		uintptr_t second;
+		size_t range;
+	};
+	std::sort(runs.begin(), runs.end(), [](const auto& left, const auto& right) { return std::get<1>(left) < std::get<1>(right); });
+	std::vector<window> windows;
+	for (auto& run : runs)
+	{
+		const auto& range = m_dirtyWatch->ranges[std::get<0>(run)];
+		const uintptr_t first = std::max(range.scanBegin, std::get<1>(run) - std::min(std::get<1>(run), span - 1));
+		if (!windows.empty() && windows.back().range == std::get<0>(run) && windows.back().second >= first)
+		{
+			windows.back().second = std::get<2>(run);
+		}
+		else
+		{
+			windows.push_back({ first, std::get<2>(run), std::get<0>(run) });
+		}
+	}
+	m_matches.erase(std::remove_if(m_matches.begin(), m_matches.end(), [&](const pattern_match& match)
+	{
+		const uintptr_t address = reinterpret_cast<uintptr_t>(match.get<void>());
+		auto it = std::upper_bound(windows.begin(), windows.end(), address, [](uintptr_t value, const window& entry) { return value < entry.first; });
+		return it != windows.begin() && address < std::prev(it)->second;
+	}), m_matches.end());
+
+	private_vector<uint8_t> copy;
+	size_t rescanned = 0;
+	for (auto& window : windows)
+	{
+		const auto& range = m_dirtyWatch->ranges[window.range];
+		const uintptr_t end = std::min(range.scanEnd, window.second + span - 1);
+		if (window.first >= end)
+		{
+			continue;
+		}
+		const uint8_t* data = reinterpret_cast<const uint8_t*>(window.first);
+		size_t size = end - window.first;
+		if (m_safeRead || m_memorySources.kinds != 0)
+		{
+			copy.resize(size);
+			size = memory_maps::ReadSelf(copy.data(), window.first, size);
+			data = copy.data();
+		}
+		rescanned += size;
+
+		scanner.Scan(data, size, window.first, [&](uintptr_t found)
+		{
+			// a gapped match may start behind the written pages, it is still in m_matches
+			if (found < window.second)
+			{
+				const uint8_t* ptr = data + (found - window.first);
+				AddMatch(found, ptr, scanner.maxMismatches() ? scanner.Mismatches(ptr) : 0);
+			}
+			return false;
+		}, range.align);
+	}
+
+	std::sort(m_matches.begin(), m_matches.end(), [](const pattern_match& left, const pattern_match& right) { return left.get<void>() < right.get<void>(); });
+	m_matches.erase(std::unique(m_matches.begin(), m_matches.end(), [](const pattern_match& left, const pattern_match& right) { return left.get<void>() == right.get<void>(); }), m_matches.end());
+
+	PATTERNS_LOGIS("Rescan: written runs: %zu, bytes rescanned: %zu, matches: %zu", runs.size(), rescanned, m_matches.size());
+	return m_matches.size();
+}
+
+// a library or section is skipped when it is in any of the ignore lists
+bool basic_pattern_impl::Wanted(const std::string& library, const std::string* section) const
+{
+	if (std::find(m_ignoreLibrarys.begin(), m_ignoreLibrarys.end(), library) != m_ignoreLibrarys.end())
+	{
+		return false;
+	}
+	if (section != nullptr)
+	{
+		if (!m_sectionNames.empty() && std::find(m_sectionNames.begin(), m_sectionNames.end(), *section) == m_sectionNames.end())
+		{
+			return false;
+		}
+		if (std::find(m_ignoreSections.begin(), m_ignoreSections.end(), *section) != m_ignoreSections.end())
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool basic_pattern_impl::ConsiderHint(uintptr_t offset)
+{
+	uint8_t* ptr = reinterpret_cast<uint8_t*>(offset);
+
+#if PATTERNS_CAN_SERIALIZE_HINTS
+	// a serialized hint may point to memory which is gone
+	const pattern_scanner scanner(m_bytes, m_mask, m_gaps, m_classes);
+	auto readable = memory_maps::Readable(offset, offset + scanner.size());
+	if (readable.empty() || readable[0].first != offset || !scanner.Compare(ptr, readable[0].second - offset))
+	{
+		return false;
+	}
+#endif
+
+	AddMatch(offset, ptr);
+
+	return true;
+}
+
+void basic_pattern_impl::AddMatch(uintptr_t address, const uint8_t* data, size_t mismatches)
+{
+	if (!m_captures && mismatches == 0)
+	{
+		m_matches.emplace_back(reinterpret_cast<void*>(address));
+		return;
+	}
+
+	std::vector<int64_t> values;
+	for (size_t i = 0; m_captures && i < m_captures->size(); i++)
+	{
+		const pattern_capture& capture = (*m_captures)[i];
+		const uint8_t* field = data + capture.offset;
+		int64_t value = 0;
+		switch (capture.type)
+		{
+		case capture_type::i8: case capture_type::rel8: value = *reinterpret_cast<const int8_t*>(field); break;
+		case capture_type::u8: value = *field; break;
+		case capture_type::i16: { int16_t v; memcpy(&v, field, sizeof(v)); value = v; break; }
+		case capture_type::u16: { uint16_t v; memcpy(&v, field, sizeof(v)); value = v; break; }
+		case capture_type::i32: case capture_type::rel32: { int32_t v; memcpy(&v, field, sizeof(v)); value = v; break; }
+		case capture_type::u32: { uint32_t v; memcpy(&v, field, sizeof(v)); value = v; break; }
+		case capture_type::i64: case capture_type::u64: memcpy(&value, field, sizeof(value)); break;
+		case capture_type::bl:
+		{
+			// imm26, in instructions
+			uint32_t insn;
+			memcpy(&insn, field, sizeof(insn));
+			value = int64_t(int32_t(insn << 6) >> 6) * 4;
+			break;
+		}
+		case capture_type::adrp:
+		{
+			// immhi:immlo, in pages
+			uint32_t insn;
+			memcpy(&insn, field, sizeof(insn));
+			uint32_t imm = (((insn >> 5) & 0x7FFFF) << 2) | ((insn >> 29) & 3);
+			value = int64_t(int32_t(imm << 11) >> 11) * 0x1000;
+			break;
+		}
+		}
+		values.push_back(value);
+	}
+	m_matches.emplace_back(reinterpret_cast<void*>(address), m_captures, std::move(values), mismatches);
+}
+
+#if PATTERNS_USE_STATS
+void basic_pattern_impl::SetLocation(pattern_location location)
+{
+	m_location = location;
+	m_tag = getCurrentTag();
+}
+
+void basic_pattern_impl::RecordStats()
+{
+	std::lock_guard<std::mutex> lock(getStatsMutex());
+
+	const std::string file = m_location.file ? m_location.file : "";
+	auto& site = getStatsRegistry()[call_site_key(file, m_location.line, m_tag, m_source)];
+	if (site.calls++ == 0)
+	{
+		site.file = file;
+		site.line = m_location.line;
+		site.tag = m_tag;
+		site.pattern = m_source;
+	}
+
+	// m_stats keeps counting over an interrupted and resumed resolve, only the part since the last record is new
+	auto Delta = [](uint64_t now, uint64_t recorded) { return now > recorded ? now - recorded : 0; };
+	pattern_stats delta{};
+	delta.bytes_scanned = Delta(m_stats.bytes_scanned, m_recorded.bytes_scanned);
+	delta.ranges_visited = Delta(m_stats.ranges_visited, m_recorded.ranges_visited);
+	delta.candidates = Delta(m_stats.candidates, m_recorded.candidates);
+	delta.matches = Delta(m_stats.matches, m_recorded.matches);
+	delta.hint_hits = Delta(m_stats.hint_hits, m_recorded.hint_hits);
+	delta.hint_misses = Delta(m_stats.hint_misses, m_recorded.hint_misses);
+	delta.metadata_ns = Delta(m_stats.metadata_ns, m_recorded.metadata_ns);
+	delta.hint_ns = Delta(m_stats.hint_ns, m_recorded.hint_ns);
+	delta.scan_ns = Delta(m_stats.scan_ns, m_recorded.scan_ns);
+	AddStats(site.stats, delta);
+	m_recorded = m_stats;
+	site.lib_name = m_libName;
+}
+#endif
+
+// selectivity from the byte frequencies of the ranges the pattern scans, then the real match count
+pattern_analysis basic_pattern_impl::Analyze()
+{
+	pattern_analysis result{};
+	result.matches = -1;
+
+	const size_t length = m_mask.size();
+	result.length = length;
+	if (length == 0)
+	{
+		result.warnings.emplace_back("empty pattern");
+		return result;
+	}
+
+	for (size_t i = 0; i < length; i++)
+	{
+		result.fixed_bits += __builtin_popcount(m_mask[i]);
+	}
+	while (result.leading_wildcards < length && m_mask[result.leading_wildcards] == 0)
+	{
+		result.leading_wildcards++;
+	}
+	while (result.trailing_wildcards < length - result.leading_wildcards && m_mask[length - 1 - result.trailing_wildcards] == 0)
+	{
+		result.trailing_wildcards++;
+	}
+
+	result.engine = m_functionStart ? "function_start" : m_safeRead ? "safe_read" : m_prefetchDistance ? "prefetch" : "plain";
+	if (m_align != 1)
+	{
+		result.engine += m_align ? " aligned(" + std::to_string(m_align) + ")" : " aligned(auto)";
+	}
+
+	// byte histogram, at most 16 MB sampled page by page over the ranges
+	std::vector<std::pair<uintptr_t, uintptr_t>> ranges;
+	if (m_memorySources.kinds != 0)
+	{
+		ranges = memory_maps::Sources(m_memorySources);
+		for (auto& range : ranges)
+		{
+			result.scanned_bytes += range.second - range.first;
+		}
+	}
+	else if (m_rangeStart || m_rangeEnd || !m_libName.empty())
+	{
+		executable_meta executable = executable_meta(m_rangeStart, m_rangeEnd, m_libName);
+		auto Collect = [&](const std::string& library, const std::string* section, uintptr_t begin, uintptr_t end)
+		{
+			if (Wanted(library, section))
+			{
+				for (auto& readable : memory_maps::Readable(begin, end))
+				{
+					ranges.emplace_back(readable);
+					result.scanned_bytes += readable.second - readable.first;
+				}
+			}
+		};
+		if (m_findSection)
+		{
+			for (auto& section : executable.get_sections(m_findExecutable))
+			{
+				Collect(section.first.first, &section.first.second, section.second.first, section.second.second);
+			}
+		}
+		else
+		{
+			for (auto& segment : executable.get_segments(m_findExecutable))
+			{
+				Collect(segment.first.first, nullptr, segment.second.first, segment.second.second);
+			}
+		}
+	}
+
+	double frequency[256];
+	std::fill(std::begin(frequency), std::end(frequency), 1.0 / 256);
+	if (result.scanned_bytes != 0)
+	{
+		const size_t pageSize = 0x1000;
+		const size_t step = std::max<size_t>(1, result.scanned_bytes / (16 << 20)) * pageSize;
+		uint64_t counts[256] = {};
+		uint64_t total = 0;
+		for (auto& range : ranges)
+		{
+			for (uintptr_t page = range.first; page < range.second; page += step)
+			{
+				const uint8_t* data = reinterpret_cast<const uint8_t*>(page);
+				for (size_t i = 0, end = std::min<size_t>(pageSize, range.second - page); i < end; i++)
+				{
+					counts[data[i]]++;
+				}
+				total += std::min<size_t>(pageSize, range.second - page);
+			}
+		}
+		for (int value = 0; value < 256; value++)
+		{
+			frequency[value] = total ? static_cast<double>(counts[value]) / total : 1.0 / 256;
+		}
+	}
+
+	// probability that a random byte passes position i
+	auto Probability = [&](size_t i) -> double
+	{
+		double p = 0;
+		auto byteClass = std::find_if(m_classes.begin(), m_classes.end(), [&](const pattern_class& entry) { return entry.position == i; });
+		for (int value = 0; value < 256; value++)
+		{
+			if ((value & m_mask[i]) == m_bytes[i] && (byteClass == m_classes.end() || byteClass->test(static_cast<uint8_t>(value))))
+			{
+				p += frequency[value];
+			}
+		}
+		return p;
+	};
+
+	// verifications per scanned byte of the window [first, last]: P(last byte) / average shift
+	auto Cost = [&](size_t first, size_t last, double& averageShift, double& windowProbability) -> double
+	{
+		const std::basic_string<uint8_t> bytes = m_bytes.substr(first, last - first + 1), mask = m_mask.substr(first, last - first + 1);
+		const pattern_scanner scanner(bytes, mask);
+
+		averageShift = 0;
+		for (int value = 0; value < 256; value++)
+		{
+			averageShift += frequency[value] * scanner.shift(static_cast<uint8_t>(value));
+		}
+		windowProbability = 1;
+		for (size_t i = first; i <= last; i++)
+		{
+			windowProbability *= Probability(i);
+		}
+		return Probability(last) / std::max(averageShift, 1.0);
+	};
+
+	double probability = 0;
+	const double cost = Cost(0, length - 1, result.average_shift, probability);
+	const double scanned = static_cast<double>(result.scanned_bytes ? result.scanned_bytes : 16 << 20);
+	result.candidates_per_mb = cost * 1048576;
+	result.false_matches = probability * scanned;
+
+	if (result.trailing_wildcards)
+	{
+		result.warnings.emplace_back("trailing wildcards: the last byte matches everything, every position is verified and the skip table is useless");
+	}
+	else
+	{
+		for (size_t i = length - 1; i-- > 0;)
+		{
+			if (m_mask[i] != 0xFF && length - 1 - i < length / 2)
+			{
+				result.warnings.emplace_back("masked byte at offset " + std::to_string(i) + " limits the skip to " + std::to_string(length - 1 - i) + " bytes");
+				break;
+			}
+		}
+	}
+	if (result.leading_wildcards)
+	{
+		result.warnings.emplace_back("leading wildcards add no selectivity, drop them and add the offset to the match");
+	}
+	if (result.fixed_bits < 32)
+	{
+		result.warnings.emplace_back("only " + std::to_string(result.fixed_bits) + " fixed bits, expect random matches");
+	}
+	if (!m_gaps.empty())
+	{
+		result.engine += " gapped";
+		result.warnings.emplace_back("gaps: the estimates treat the fragments as contiguous, no variant is suggested");
+	}
+	if (!m_classes.empty())
+	{
+		result.engine += " classes";
+	}
+	if (m_captures)
+	{
+		result.warnings.emplace_back("captures: no variant is suggested, it would drop them");
+	}
+
+	// real count over the same ranges, on a copy: the matches, the resume progress and the incremental state
+	// of this pattern stay as they are (an earlier count(1) resolve stops at the first match)
+	if (result.scanned_bytes != 0)
+	{
+		basic_pattern_impl counter(*this);
+		counter.m_matches.clear();
+		counter.m_matched = false;
+		counter.m_progress = {};
+		counter.m_scannedRanges.clear();
+		counter.m_incremental = false;
+		counter.m_dirtyWatch.reset();
+		counter.m_deadline = std::chrono::steady_clock::time_point::max(); // the count is complete, a cancellation still stops it
+
+		auto started = std::chrono::steady_clock::now();
+		counter.EnsureMatches(UINT32_MAX);
+		result.scan_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+		result.matches = static_cast<int64_t>(counter.m_matches.size());
+		if (result.matches == 0)
+		{
+			result.warnings.emplace_back("no match in the scanned ranges");
+		}
+	}
+
+	// tighter variant: the cheapest window with fixed ends which expects no more random matches,
+	// checked against the real count when there is one
+	auto CountWindow = [&](size_t first, size_t last) -> int64_t
+	{
+		const std::basic_string<uint8_t> bytes = m_bytes.substr(first, last - first + 1), mask = m_mask.substr(first, last - first + 1);
+		const pattern_scanner scanner(bytes, mask);
+		int64_t count = 0;
+		for (auto& range : ranges)
+		{
+			scanner.Scan(reinterpret_cast<const uint8_t*>(range.first), range.second - range.first, range.first, [&](uintptr_t) { count++; return false; });
+		}
+		return count;
+	};
+
+	struct window
+	{
+		size_t first;
+		size_t last;
+		double cost;
+	};
+	std::vector<window> windows;
+	const size_t limit = std::min<size_t>(length, 64);
+	for (size_t first = 0; first < limit; first++)
+	{
+		for (size_t last = first; last < limit; last++)
+		{
+			if (m_mask[first] == 0 || m_mask[last] == 0 || (first == 0 && last == length - 1))
+			{
+				continue;
+			}
+			double shift, windowProbability;
+			const double windowCost = Cost(first, last, shift, windowProbability);
+			if (windowProbability * scanned <= std::max(0.01, result.false_matches * 1.001) && (windowCost < cost * 0.5 || (last - first + 1 < length && windowCost <= cost)))
+			{
+				windows.push_back({ first, last, windowCost });
+			}
+		}
+	}
+	std::sort(windows.begin(), windows.end(), [](const window& left, const window& right) 
+	{
+		return left.cost != right.cost ? left.cost < right.cost : left.last - left.first < right.last - right.first; 
+	});
+
+	for (size_t i = 0; i < windows.size() && i < 4 && result.matches != 0 && m_gaps.empty() && m_classes.empty() && !m_captures; i++)
+	{
+		if (result.matches >= 0 && CountWindow(windows[i].first, windows[i].last) != result.matches)
+		{
+			continue;
+		}
+
+		std::ostringstream out;
+		out << std::uppercase << std::hex << std::setfill('0');
+		for (size_t j = windows[i].first; j <= windows[i].last; j++)
+		{
+			out << (j == windows[i].first ? "" : " ");
+			if (m_mask[j] == 0)
+			{
+				out << "?";
+			}
+			else
+			{
+				out << std::setw(2) << static_cast<int>(m_bytes[j]);
+				if (m_mask[j] != 0xFF)
+				{
+					out << "&" << std::setw(2) << static_cast<int>(m_mask[j]);
+				}
+			}
+		}
+		result.suggestion = out.str();
+		result.suggestion_offset = -static_cast<ptrdiff_t>(windows[i].first);
+		break;
+	}
+	return result;
+}
+
+#if PATTERNS_USE_HINTS && PATTERNS_CAN_SERIALIZE_HINTS
+bool basic_pattern_impl::ConsiderProximity()
+{
+	const pattern_scanner scanner(m_bytes, m_mask, m_gaps, m_classes);
+
+	// expanding windows (4 KB, 64 KB, 1 MB ...) centred on the old locations (saved hints are rebased onto their module),
+	// accepted once they hold as many matches as there were hints
+	for (size_t radius = std::min<size_t>(0x1000, m_hintProximity); ; radius = std::min(radius << 4, m_hintProximity))
+	{
+		std::vector<uintptr_t> found;
+		for (uintptr_t hint : m_staleHints)
+		{
+			uintptr_t begin = (hint > radius) ? hint - radius : 0;
+			uintptr_t end = hint + radius + scanner.size();
+			if (m_rangeEnd != 0)
+			{
+				begin = std::max(begin, m_rangeStart);
+				end = std::min(end, m_rangeEnd);
+			}
+
+			// the same candidates as the full scan
+			const size_t align = m_align ? m_align : GetModuleAlignment(hint);
+			for (auto& readable : memory_maps::Readable(begin, end))
+			{
+				scanner.Scan(reinterpret_cast<const uint8_t*>(readable.first), readable.second - readable.first, readable.first, [&](uintptr_t address)
+				{
+					found.emplace_back(address);
+					return false;
+				}, align);
+			}
+		}
+
+		std::sort(found.begin(), found.end());
+		found.erase(std::unique(found.begin(), found.end()), found.end());
+
+		if (found.size() == m_staleHints.size())
+		{
+			auto& hints = getHints();
+			auto range = hints.equal_range(m_hash);
+			for (auto it = range.first; it != range.second;)
+			{
+				it = (std::find(m_staleHints.begin(), m_staleHints.end(), it->second) != m_staleHints.end()) ? hints.erase(it) : std::next(it);
+			}
+			auto& saved = getModuleHints();
+			auto savedRange = saved.equal_range(m_hash);
+			for (auto it = savedRange.first; it != savedRange.second;)
+			{
+				it = (std::find(m_staleHints.begin(), m_staleHints.end(), RebaseHint(it->second)) != m_staleHints.end()) ? saved.erase(it) : std::next(it);
+			}
+
+			for (uintptr_t address : found)
+			{
+				PATTERNS_LOGIS("ConsiderProximity: hint moved, radius: %zu, address: " PATTERNS_ADDR_FMT "", radius, address);
+				hints.emplace(m_hash, address);
+				AddMatch(address, reinterpret_cast<const uint8_t*>(address));
+			}
+			m_staleHints.clear();
+			return true;
+		}
+
+		// a larger window only finds more
+		if (found.size() > m_staleHints.size() || radius >= m_hintProximity)
+		{
+			break;
+		}
+	}
+	return false;
+}
+
+void basic_pattern_impl::hint(uint64_t hash, uintptr_t address)
+{
+	auto& hints = getHints();
+
+	auto range = hints.equal_range(hash);
+
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (it->second == address)
+		{
+			return;
+		}
+	}
+
+	hints.emplace(hash, address);
+}
+
+void basic_pattern_impl::hint(const pattern_hint& hint)
+{
+	auto& hints = getModuleHints();
+
+	auto range = hints.equal_range(hint.hash);
+
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (it->second.first == hint.lib_name && it->second.second == hint.offset)
+		{
+			return;
+		}
+	}
+
+	hints.emplace(hint.hash, std::make_pair(hint.lib_name, hint.offset));
+}
+
+std::vector<pattern_hint> basic_pattern_impl::get_hints()
+{
+	std::set<std::tuple<uint64_t, std::string, uintptr_t>> unique;
+	for (auto& hint : getHints())
+	{
+		// the file name: the directory of an app's libraries changes between installs
+		loaded_module module;
+		if (FindLoadedModule(hint.second, module))
+		{
+			unique.emplace(hint.first, module.name.substr(module.name.find_last_of('/') + 1), hint.second - module.base);
+		}
+	}
+
+	// saved hints of modules which were not looked up in this run are kept for the next one
+	for (auto& hint : getModuleHints())
+	{
+		unique.emplace(hint.first, hint.second.first, hint.second.second);
+	}
+
+	std::vector<pattern_hint> result;
+	for (auto& hint : unique)
+	{
+		result.push_back({ std::get<0>(hint), std::get<1>(hint), std::get<2>(hint) });
+	}
+	return result;
+}
+#endif
+
+}
+
+std::string to_string(const pattern_analysis& analysis)
+{
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(2);
+	out << "length " << analysis.length << ", fixed bits " << analysis.fixed_bits << ", engine " << analysis.engine
+		<< ", average shift " << analysis.average_shift << ", candidates/MB " << analysis.candidates_per_mb
+		<< ", expected random matches " << analysis.false_matches;
+	if (analysis.matches >= 0)
+	{
+		out << ", matches " << analysis.matches << " in " << analysis.scanned_bytes << " bytes (" << analysis.scan_ms << " ms)";
+	}
+	out << "\n";
+	for (auto& warning : analysis.warnings)
+	{
+		out << "  warning: " << warning << "\n";
+	}
+	if (!analysis.suggestion.empty())
+	{
+		out << "  suggestion: \"" << analysis.suggestion << "\", offset " << analysis.suggestion_offset << "\n";
+	}
+	return out.str();
+}
+
+// one signature per line, '#' starts a comment line
+std::string analyze_signatures(const std::string& path, const std::string& lib_name)
+{
+	std::ifstream fp(path);
+	if (!fp)
+	{
+		PATTERNS_LOGES("analyze_signatures: open %s failed", path.c_str());
+		return {};
+	}
+
+	std::ostringstream out;
+	std::string line;
+	uint32_t number = 0;
+	while (std::getline(fp, line))
+	{
+		number++;
+		line.erase(0, line.find_first_not_of(" \t"));
+		line.erase(line.find_last_not_of(" \t\r") + 1);
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+
+		// attributed to the signature file line
+		pattern signature = make_section_pattern(lib_name.empty() ? details::get_process_name() : lib_name, "", line, { path.c_str(), number });
+		out << "\"" << line << "\": " << to_string(signature.analyze());
+	}
+	return out.str();
+}
+
+// deferred patterns
+// key: id, patterns wait for their library and are resolved in one batched scan per module
+struct deferred_entry
+{
+	size_t id;
+	std::string libName;
+	std::basic_string<uint8_t> bytes;
+	std::basic_string<uint8_t> mask;
+	uint32_t count;
+	bool executable;
+	int priority;
+	std::string text; // for the targeted resolve of priority patterns
+	deferred_callback callback;
+	std::vector<pattern_match> matches;
+};
+
+struct deferred_registry
+{
+	std::mutex mutex;
+	std::map<size_t, deferred_entry> entries;
+	size_t nextId = 1;
+	uint64_t generation = 0;
+
+	std::mutex watcherMutex;
+	std::condition_variable watcherCondition;
+	std::thread watcher;
+	bool watcherStop = false;
+};
+
+// loaded module: name, segments (begin : end, executable)
+struct deferred_module
+{
+	std::string name;
+	std::vector<std::pair<std::pair<uintptr_t, uintptr_t>, bool>> segments;
+};
+
+static auto& getDeferredRegistry()
+{
+	static deferred_registry registry;
+	return registry;
+}
+
+// one pass over [begin, end) for every pattern, candidates are bucketed by the byte at each pattern's anchor
+static void MatchesBatch(uintptr_t begin, uintptr_t end, const std::vector<deferred_entry*>& entries)
+{
+	std::vector<std::pair<deferred_entry*, size_t>> buckets[256];
+	for (auto entry : entries)
+	{
+		// anchor: the most specific byte of the pattern
+		size_t anchor = 0;
+		for (size_t i = 0; i < entry->mask.size(); i++)
+		{
+			if (entry->mask[i] == 0xFF) { anchor = i; break; }
+			if (entry->mask[i] > entry->mask[anchor]) anchor = i;
+		}
+		for (int value = 0; value < 256; value++)
+		{
+			if ((value & entry->mask[anchor]) == entry->bytes[anchor])
+			{
+				buckets[value].emplace_back(entry, anchor);
+			}
+		}
+	}
+
+	for (uintptr_t i = begin; i < end; i++)
+	{
+		for (auto& candidate : buckets[*reinterpret_cast<const uint8_t*>(i)])
+		{
+			deferred_entry* entry = candidate.first;
+			const size_t size = entry->mask.size();
+			if (i - begin < candidate.second || end - (i - candidate.second) < size || entry->matches.size() >= entry->count)
+			{
+				continue;
+			}
+
+			const uint8_t* ptr = reinterpret_cast<const uint8_t*>(i - candidate.second);
+			size_t j = 0;
+			while (j < size && entry->bytes[j] == (ptr[j] & entry->mask[j])) j++;
+
+			if (j == size)
+			{
+				entry->matches.emplace_back(const_cast<uint8_t*>(ptr));
+			}
+		}
+	}
+}
+
+// priority patterns: a resolve of their own per segment, the segments and order of the batched scan so the matches
+// do not depend on the priority; hinted, and each scan stops once count is reached. Not scoped to function entries
+// (function_start), that would return other matches than the batch
+static void ResolveDeferredTargeted(const deferred_module& module, deferred_entry& entry)
+{
+	for (auto& segment : module.segments)
+	{
+		if (entry.matches.size() >= entry.count)
+		{
+			break;
+		}
+		if (entry.executable && !segment.second)
+		{
+			continue;
+		}
+
+		const uintptr_t begin = segment.first.first, end = segment.first.second;
+		const uint32_t wanted = entry.count - static_cast<uint32_t>(entry.matches.size());
+		// ascending and unique, the same hint may have been recorded by more than one scan
+		std::vector<uintptr_t> found;
+		auto Collect = [&](pattern& targeted)
+		{
+			found.clear();
+			targeted.count_hint(wanted).for_each_result([&](const pattern_match& match)
+			{
+				const uintptr_t address = reinterpret_cast<uintptr_t>(match.get<void>());
+				if (address >= begin && address < end)
+				{
+					found.emplace_back(address);
+				}
+			});
+			std::sort(found.begin(), found.end());
+			found.erase(std::unique(found.begin(), found.end()), found.end());
+		};
+
+		// the hints are keyed by the pattern text alone and hold the matches some scan stopped at: they are only
+		// taken when the ones inside this segment cover what is still wanted, all matches always need a scan
+		pattern targeted = make_range_pattern(begin, end, entry.text);
+		if (entry.count == UINT32_MAX)
+		{
+			targeted.clear();
+		}
+		Collect(targeted);
+		if (targeted.progress().bytes_scanned == 0 && found.size() < wanted)
+		{
+			targeted.clear();
+			Collect(targeted);
+		}
+
+		for (size_t i = 0; i < found.size() && i < wanted; i++)
+		{
+			entry.matches.emplace_back(reinterpret_cast<void*>(found[i]));
+		}
+	}
+	entry.callback(entry.matches);
+}
+
+// the priority 0 patterns of a module in one pass per segment
+static void ResolveDeferredModule(const deferred_module& module, std::vector<deferred_entry>& entries)
+{
+	PATTERNS_LOGIS("ResolveDeferredModule: lib_name: %s, patterns: %zu", module.name.c_str(), entries.size());
+
+	for (auto& segment : module.segments)
+	{
+		std::vector<deferred_entry*> scan;
+		for (auto& entry : entries)
+		{
+			if (!entry.executable || segment.second)
+			{
+				scan.emplace_back(&entry);
+			}
+		}
+		if (scan.empty())
+		{
+			continue;
+		}
+
+		for (auto& readable : memory_maps::Readable(segment.first.first, segment.first.second))
+		{
+			MatchesBatch(readable.first, readable.second, scan);
+		}
+	}
+
+	for (auto& entry : entries)
+	{
+		entry.callback(entry.matches);
+	}
+}
+
+static bool MakeDeferredEntry(const std::string& lib_name, std::string_view pattern, deferred_callback callback, uint32_t count, bool executable, int priority, deferred_entry& entry)
+{
+	if (lib_name.empty() || !callback)
+	{
+		PATTERNS_LOGE("register_deferred_pattern: lib_name or callback is empty.");
+		return false;
+	}
+
+	entry.libName = lib_name;
+	entry.count = count;
+	entry.executable = executable;
+	entry.priority = priority;
+	entry.callback = std::move(callback);
+	TransformPattern(pattern, entry.bytes, entry.mask);
+	if (entry.mask.empty())
+	{
+		PATTERNS_LOGE("register_deferred_pattern: pattern is empty.");
+		return false;
+	}
+	if (priority > 0)
+	{
+		entry.text = pattern;
+	}
+	return true;
+}
+
+size_t register_deferred_pattern(const std::string& lib_name, std::string_view pattern, deferred_callback callback, uint32_t count, bool executable, int priority)
+{
+	deferred_entry entry{};
+	if (!MakeDeferredEntry(lib_name, pattern, std::move(callback), count, executable, priority, entry))
+	{
+		return 0;
+	}
+
+	auto& registry = getDeferredRegistry();
+	size_t id = 0;
+	{
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		id = entry.id = registry.nextId++;
+		registry.entries.emplace(id, std::move(entry));
+		registry.generation = 0; // the library may already be loaded
+	}
 
-						PATTERNS_LOGIS("executable_meta::Initialize: lib_name: %s, segment_id: %d, begin: " PATTERNS_ADDR_FMT ", end: " PATTERNS_ADDR_FMT "", 
-							name.first.c_str(), name.second, begin, end);
-						break;
-					}
-				}
+	resolve_deferred_patterns();
+	return id;
+}
+
+std::vector<size_t> register_deferred_patterns(std::vector<deferred_request> requests)
+{
+	std::vector<deferred_entry> entries(requests.size());
+	std::vector<size_t> ids(requests.size(), 0);
+	for (size_t i = 0; i < requests.size(); i++)
+	{
+		auto& request = requests[i];
+		if (!MakeDeferredEntry(request.lib_name, request.pattern, std::move(request.callback), request.count, request.executable, request.priority, entries[i]))
+		{
+			entries[i].mask.clear();
+		}
+	}
+
+	auto& registry = getDeferredRegistry();
+	{
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			if (!entries[i].mask.empty())
+			{
+				ids[i] = entries[i].id = registry.nextId++;
+				registry.entries.emplace(ids[i], std::move(entries[i]));
 			}
-			return;
 		}
+		registry.generation = 0;
+	}
 
-		std::pair<std::string, std::string> section_name;
-		std::pair<std::string, uint16_t> segment_name;
-		if (!m_name.empty())
+	resolve_deferred_patterns();
+	return ids;
+}
+
+bool unregister_deferred_pattern(size_t id)
+{
+	auto& registry = getDeferredRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	return registry.entries.erase(id) != 0;
+}
+
+size_t resolve_deferred_patterns()
+{
+	auto& registry = getDeferredRegistry();
+
+	// nothing was loaded since the last call: one dl_iterate_phdr callback
+	{
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		uint64_t generation = GetModuleGeneration();
+		if (registry.entries.empty() || (generation != 0 && generation == registry.generation))
 		{
-			FindLibrarys();
+			return 0;
+		}
+		registry.generation = generation;
+	}
 
-			if (!m_sections.empty())
+	std::vector<deferred_module> modules;
+	PATTERNS_DL_ITERATE_PHDR([](struct dl_phdr_info* info, size_t size, void* data) -> int
+		{
+			if (info->dlpi_name == nullptr || info->dlpi_phdr == nullptr)
 			{
-				for (auto& section : m_sections)
+				return 0;
+			}
+
+			auto& modules = *reinterpret_cast<std::vector<deferred_module>*>(data);
+			modules.emplace_back();
+			modules.back().name = info->dlpi_name;
+			for (int i = 0; i < info->dlpi_phnum; i++)
+			{
+				const elf_phdr& phdr = info->dlpi_phdr[i];
+				if (phdr.p_type == PT_LOAD && (phdr.p_flags & PF_R))
 				{
-					if (section.second.first <= begin && end <= section.second.second)
-					{
-						section_name = section.first;
-						break;
-					}
+					modules.back().segments.emplace_back(std::make_pair(info->dlpi_addr + phdr.p_vaddr, info->dlpi_addr + phdr.p_vaddr + phdr.p_memsz), (phdr.p_flags & PF_X) != 0);
 				}
 			}
+			return 0;
+		}, &modules);
 
-			if (!m_segments.empty())
+	// the patterns of the loaded modules, split into the priority ones and the batch of each module
+	std::vector<std::pair<const deferred_module*, deferred_entry>> targeted;
+	std::vector<std::pair<const deferred_module*, std::vector<deferred_entry>>> batches;
+	{
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		for (auto& module : modules)
+		{
+			std::vector<deferred_entry> entries;
+			for (auto it = registry.entries.begin(); it != registry.entries.end();)
 			{
-				for (auto& segment : m_segments)
+				if (strstr(module.name.c_str(), it->second.libName.c_str()))
 				{
-					if (segment.second.first <= begin && end <= segment.second.second)
+					if (it->second.priority > 0)
 					{
-						segment_name = segment.first;
-						goto end;
+						targeted.emplace_back(&module, std::move(it->second));
+					}
+					else
+					{
+						entries.emplace_back(std::move(it->second));
 					}
+					it = registry.entries.erase(it);
+					continue;
 				}
+				++it;
+			}
+			if (!entries.empty())
+			{
+				batches.emplace_back(&module, std::move(entries));
 			}
-			PATTERNS_LOGE("executable_meta: begin and end is not in the same segment or section.");
-			return;
 		}
-	end:
-		m_sections.clear();
-		m_sections.emplace(section_name, std::make_pair(begin, end));
-		m_executable_sections.clear();
-		m_executable_sections.emplace(section_name, std::make_pair(begin, end));
-		m_segments.clear();
-		m_segments.emplace(segment_name, std::make_pair(begin, end));
-		m_executable_segments.clear();
-		m_executable_segments.emplace(segment_name, std::make_pair(begin, end));
-	}
-
-	executable_meta(uintptr_t begin, uintptr_t end, const std::string& lib_name)
-		: executable_meta(lib_name)
-	{
-		Initialize(begin, end);
 	}
 
-	~executable_meta()
+	// callbacks run without the registry lock, they may register more patterns
+	std::stable_sort(targeted.begin(), targeted.end(), [](const auto& left, const auto& right) { return left.second.priority > right.second.priority; });
+	for (auto& entry : targeted)
 	{
-		for (auto& elf : m_elf)
-		{
-			munmap(elf.first, elf.second);
-		}
-		m_elf.clear();
-		m_name.clear();
-		m_sections.clear();
-		m_executable_sections.clear();
-		m_segments.clear();
-		m_executable_segments.clear();
+		ResolveDeferredTargeted(*entry.first, entry.second);
 	}
 
-	inline const std::map<std::pair<const std::string, const std::string>, std::pair<uintptr_t, uintptr_t>>& get_sections(bool is_executable)
+	size_t resolved = targeted.size();
+	for (auto& batch : batches)
 	{
-		return is_executable ? m_executable_sections : m_sections;
+		ResolveDeferredModule(*batch.first, batch.second);
+		resolved += batch.second.size();
 	}
+	return resolved;
+}
 
-	inline const std::map<std::pair<const std::string, uint16_t>, std::pair<uintptr_t, uintptr_t>>& get_segments(bool is_executable)
+void* deferred_dlopen(const char* filename, int flags)
+{
+	void* handle = dlopen(filename, flags);
+	if (handle != nullptr)
 	{
-		return is_executable ? m_executable_segments : m_segments;
+		resolve_deferred_patterns();
 	}
-};
-
-namespace details
-{
+	return handle;
+}
 
-void basic_pattern_impl::Initialize(std::string_view pattern)
+bool start_deferred_watcher(std::chrono::milliseconds interval)
 {
-	// get the hash for the base pattern
-#if PATTERNS_USE_HINTS
-	m_hash = fnv_1()(pattern);
-#endif
+	auto& registry = getDeferredRegistry();
 
-	// transform the base pattern from IDA format to canonical format
-	TransformPattern(pattern, m_bytes, m_mask);
+	// a joinable thread in the registry destructor terminates the process, stop it before the statics go away
+	static const bool stopAtExit = std::atexit([]() { stop_deferred_watcher(); }) == 0;
+	if (!stopAtExit)
+	{
+		PATTERNS_LOGW("start_deferred_watcher: atexit failed, stop_deferred_watcher must be called before exit.");
+	}
 
-#if PATTERNS_USE_HINTS
-	// if there's hints, try those first
-#if PATTERNS_CAN_SERIALIZE_HINTS
-	if (m_rangeStart == get_process_base(m_libName))
-#endif
+	std::lock_guard<std::mutex> lock(registry.watcherMutex);
+	if (registry.watcher.joinable())
 	{
-		auto range = getHints().equal_range(m_hash);
+		return false;
+	}
 
-		if (range.first != range.second)
+	registry.watcherStop = false;
+	registry.watcher = std::thread([interval, &registry]()
 		{
-			std::for_each(range.first, range.second, [&] (const auto& hint)
-			{
-				ConsiderHint(hint.second);
-			});
-
-			// if the hints succeeded, we don't need to do anything more
-			if (!m_matches.empty())
+			std::unique_lock<std::mutex> lock(registry.watcherMutex);
+			while (!registry.watcherCondition.wait_for(lock, interval, [&registry]() { return registry.watcherStop; }))
 			{
-				m_matched = true;
-				return;
+				lock.unlock();
+				resolve_deferred_patterns();
+				lock.lock();
 			}
-		}
-	}
-#endif
+		});
+	return true;
 }
 
-void basic_pattern_impl::EnsureMatches(uint32_t maxCount)
+void stop_deferred_watcher()
 {
-	if (m_matched || (!m_rangeStart && !m_rangeEnd && m_libName.empty()))
+	auto& registry = getDeferredRegistry();
+	std::thread watcher;
 	{
-		return;
+		std::lock_guard<std::mutex> lock(registry.watcherMutex);
+		registry.watcherStop = true;
+		watcher = std::move(registry.watcher);
 	}
-
-	// scan the executable for code
-	executable_meta executable = executable_meta(m_rangeStart, m_rangeEnd, m_libName);
-
-	auto matchSuccess = [&](uintptr_t address)
+	registry.watcherCondition.notify_all();
+	if (watcher.joinable())
 	{
-#if PATTERNS_USE_HINTS
-		getHints().emplace(m_hash, address);
-#else
-		(void)address;
-#endif
-
-		return (m_matches.size() == maxCount);
-	};
-
-	const uint8_t* pattern = m_bytes.data();
-	const uint8_t* mask = m_mask.data();
-	const size_t maskSize = m_mask.size();
-	const size_t lastWild = m_mask.find_last_not_of(uint8_t(0xFF));
+		watcher.join();
+	}
+}
 
-	ptrdiff_t Last[256];
+namespace details
+{
 
-	std::fill(std::begin(Last), std::end(Last), lastWild == std::string::npos ? -1 : static_cast<ptrdiff_t>(lastWild));
+template<typename Function>
+static void WithValueType(value_type type, Function&& function)
+{
+	switch (type)
+	{
+	case value_type::i8: function(int8_t{}); break;
+	case value_type::u8: function(uint8_t{}); break;
+	case value_type::i16: function(int16_t{}); break;
+	case value_type::u16: function(uint16_t{}); break;
+	case value_type::i32: function(int32_t{}); break;
+	case value_type::u32: function(uint32_t{}); break;
+	case value_type::i64: function(int64_t{}); break;
+	case value_type::u64: function(uint64_t{}); break;
+	case value_type::f32: function(float{}); break;
+	case value_type::f64: function(double{}); break;
+	}
+}
 
-	for (ptrdiff_t i = 0; i < static_cast<ptrdiff_t>(maskSize); ++i)
+// the test of a first scan predicate, test(value)
+template<typename T, typename Run>
+static void WithFirstTest(value_predicate predicate, T a, T b, Run&& run)
+{
+	switch (predicate)
 	{
-		if (Last[pattern[i]] < i)
-		{
-			Last[pattern[i]] = i;
-		}
+	case value_predicate::any: run([](T) { return true; }); break;
+	case value_predicate::equal: run([a](T value) { return value == a; }); break;
+	case value_predicate::not_equal: run([a](T value) { return value != a; }); break;
+	case value_predicate::less: run([a](T value) { return value < a; }); break;
+	case value_predicate::greater: run([a](T value) { return value > a; }); break;
+	case value_predicate::within: run([a, b](T value) { return value >= a && value <= b; }); break;
+	default: PATTERNS_LOGE("value_scan: changed / unchanged / increased / decreased need a first scan"); break;
 	}
+}
 
-	static auto Matches = [&](uintptr_t begin, uintptr_t end) -> void
+// the test of a next scan predicate, test(value, previous); changed / unchanged compare the bits (NaN stays unchanged)
+template<typename T, typename Run>
+static void WithNextTest(value_predicate predicate, T a, T b, Run&& run)
+{
+	switch (predicate)
 	{
-		try
-		{
-			for (uintptr_t i = begin, ends = end - maskSize; i <= ends;)
-			{
-				uint8_t* ptr = reinterpret_cast<uint8_t*>(i);
-				ptrdiff_t j = maskSize - 1;
+	case value_predicate::equal: run([a](T value, T) { return value == a; }); break;
+	case value_predicate::not_equal: run([a](T value, T) { return value != a; }); break;
+	case value_predicate::less: run([a](T value, T) { return value < a; }); break;
+	case value_predicate::greater: run([a](T value, T) { return value > a; }); break;
+	case value_predicate::within: run([a, b](T value, T) { return value >= a && value <= b; }); break;
+	case value_predicate::changed: run([](T value, T previous) { return memcmp(&value, &previous, sizeof(T)) != 0; }); break;
+	case value_predicate::unchanged: run([](T value, T previous) { return memcmp(&value, &previous, sizeof(T)) == 0; }); break;
+	case value_predicate::increased: run([](T value, T previous) { return value > previous; }); break;
+	case value_predicate::decreased: run([](T value, T previous) { return value < previous; }); break;
+	default: PATTERNS_LOGE("value_scan: any is only a first scan predicate"); break;
+	}
+}
 
-				while ((j >= 0) && pattern[j] == (ptr[j] & mask[j])) j--;
+value_scan_impl::value_scan_impl(value_type type, size_t valueSize, const memory_sources& sources, size_t alignment)
+	: m_type(type), m_valueSize(valueSize), m_align(std::max<size_t>(1, alignment)), m_sources(sources)
+{
+	static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	m_wordsPerPage = ((pageSize - m_valueSize) / m_align + 1 + 63) / 64;
+}
 
-				if (j < 0)
-				{
-					m_matches.emplace_back(ptr);
-					if (matchSuccess(i))
-					{
-						break;
-					}
-					i++;
-				}
-				else
-				{
-					i += std::max(ptrdiff_t(1), j - Last[ptr[j]]);
-				}
-			}
-		}
-		catch (const std::exception& e)
-		{
-			PATTERNS_LOGES("Matches exceptional: %s", e.what());
-		}
-	};
-	
-	if (m_findSection)
+size_t value_scan_impl::First(value_predicate predicate, const void* a, const void* b)
+{
+	static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	const size_t slots = (pageSize - m_valueSize) / m_align + 1;
+
+	m_pages.clear();
+	m_bits.clear();
+	m_values.clear();
+	m_count = 0;
+
+	// the ranges are copied 64 pages at a time, an unmapped page is skipped instead of faulting
+	private_vector<uint8_t> buffer(64 * pageSize);
+	private_vector<uint64_t> bits(m_wordsPerPage);
+	WithValueType(m_type, [&](auto tag)
 	{
-		auto& sections = executable.get_sections(m_findExecutable);
-		for (auto& section : sections)
+		using T = decltype(tag);
+		T first, second;
+		memcpy(&first, a, sizeof(T));
+		memcpy(&second, b, sizeof(T));
+
+		WithFirstTest<T>(predicate, first, second, [&](auto test)
 		{
-			if (m_ignoreLibrarys.empty())
+			for (auto& range : memory_maps::Sources(m_sources))
 			{
-				if (m_sectionNames.empty())
-				{
-					if (m_ignoreSections.empty())
-					{
-						Matches(section.second.first, section.second.second);
-					}
-					else
-					{
-						for (auto& ignoreSection : m_ignoreSections)
-						{
-							if (section.first.second != ignoreSection)
-							{
-								Matches(section.second.first, section.second.second);
-							}
-						}
-					}
-				}
-				else
+				for (uintptr_t cursor = range.first; cursor < range.second;)
 				{
-					for (auto& sectionName : m_sectionNames)
+					const size_t want = std::min<size_t>(buffer.size(), range.second - cursor);
+					const size_t read = memory_maps::ReadSelf(buffer.data(), cursor, want) & ~(pageSize - 1);
+					for (size_t offset = 0; offset < read; offset += pageSize)
 					{
-						if (section.first.second == sectionName)
+						// 64 slots per word without branches, the loop the compiler vectorises
+						const uint8_t* page = buffer.data() + offset;
+						size_t count = 0;
+						for (size_t word = 0; word < m_wordsPerPage; word++)
 						{
-							if (m_ignoreSections.empty())
-							{
-								Matches(section.second.first, section.second.second);
-							}
-							else
+							const size_t base = word * 64, length = std::min<size_t>(64, slots - base);
+							uint64_t out = 0;
+							for (size_t i = 0; i < length; i++)
 							{
-								for (auto& ignoreSection : m_ignoreSections)
-								{
-									if (section.first.second != ignoreSection)
-									{
-										Matches(section.second.first, section.second.second);
-									}
-								}
+								T value;
+								memcpy(&value, page + (base + i) * m_align, sizeof(T));
+								out |= uint64_t(test(value)) << i;
 							}
+							bits[word] = out;
+							count += __builtin_popcountll(out);
 						}
-					}
-				}
-			}
-			else
-			{
-				for (auto& ignoreLibrary : m_ignoreLibrarys)
-				{
-					if (section.first.first != ignoreLibrary)
-					{
-						if (m_sectionNames.empty())
+						if (count == 0)
 						{
-							if (m_ignoreSections.empty())
-							{
-								Matches(section.second.first, section.second.second);
-							}
-							else
-							{
-								for (auto& ignoreSection : m_ignoreSections)
-								{
-									if (section.first.second != ignoreSection)
-									{
-										Matches(section.second.first, section.second.second);
-									}
-								}
-							}
+							continue;
 						}
-						else
+
+						m_pages.push_back({ cursor + offset, m_count });
+						m_bits.insert(m_bits.end(), bits.begin(), bits.end());
+						for (size_t word = 0; word < m_wordsPerPage; word++)
 						{
-							for (auto& sectionName : m_sectionNames)
+							for (uint64_t set = bits[word]; set != 0; set &= set - 1)
 							{
-								if (section.first.second == sectionName)
-								{
-									if (m_ignoreSections.empty())
-									{
-										Matches(section.second.first, section.second.second);
-									}
-									else
-									{
-										for (auto& ignoreSection : m_ignoreSections)
-										{
-											if (section.first.second != ignoreSection)
-											{
-												Matches(section.second.first, section.second.second);
-											}
-										}
-									}
-								}
+								const uint8_t* value = page + (word * 64 + __builtin_ctzll(set)) * m_align;
+								m_values.insert(m_values.end(), value, value + sizeof(T));
 							}
 						}
+						m_count += count;
 					}
+					cursor += (read < want) ? read + pageSize : read;
 				}
 			}
-		}
-	}
-	else
-	{
-		auto& segments = executable.get_segments(m_findExecutable);
-		for (auto& segment : segments)
-		{
-			if (m_ignoreLibrarys.empty())
-			{
-				Matches(segment.second.first, segment.second.second);
-			}
-			else
-			{
-				for (auto& ignoreLibrary : m_ignoreLibrarys)
-				{
-					if (segment.first.first != ignoreLibrary)
-					{
-						Matches(segment.second.first, segment.second.second);
-					}
-				}
-			}
-		}
-	}
+		});
+	});
 
-	m_matched = true;
+	PATTERNS_LOGIS("value_scan: first scan, candidates: %zu, pages: %zu", m_count, m_pages.size());
+	return m_count;
 }
 
-bool basic_pattern_impl::ConsiderHint(uintptr_t offset)
+size_t value_scan_impl::Next(value_predicate predicate, const void* a, const void* b)
 {
-	uint8_t* ptr = reinterpret_cast<uint8_t*>(offset);
+	static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
 
-#if PATTERNS_CAN_SERIALIZE_HINTS
-	const uint8_t* pattern = m_bytes.data();
-	const uint8_t* mask = m_mask.data();
+	private_vector<value_page> pages;
+	private_vector<uint64_t> bits;
+	private_vector<uint8_t> values;
+	size_t count = 0;
+	bool tested = false;
 
-	for (size_t i = 0, j = m_mask.size(); i < j; i++)
+	private_vector<uint8_t> buffer(64 * pageSize);
+	WithValueType(m_type, [&](auto tag)
 	{
-		if (pattern[i] != (ptr[i] & mask[i]))
+		using T = decltype(tag);
+		T first, second;
+		memcpy(&first, a, sizeof(T));
+		memcpy(&second, b, sizeof(T));
+
+		WithNextTest<T>(predicate, first, second, [&](auto test)
 		{
-			return false;
-		}
-	}
-#endif
+			tested = true;
 
-	m_matches.emplace_back(ptr);
+			// only the candidate pages are read, adjacent ones with a single process_vm_readv
+			for (size_t run = 0; run < m_pages.size();)
+			{
+				size_t runEnd = run + 1;
+				while (runEnd < m_pages.size() && runEnd - run < 64 && m_pages[runEnd].address == m_pages[runEnd - 1].address + pageSize)
+				{
+					runEnd++;
+				}
+				const size_t readEnd = run + memory_maps::ReadSelf(buffer.data(), m_pages[run].address, (runEnd - run) * pageSize) / pageSize;
 
-	return true;
-}
+				for (size_t index = run; index < readEnd; index++)
+				{
+					const uint8_t* page = buffer.data() + (index - run) * pageSize;
+					const uint64_t* oldBits = m_bits.data() + index * m_wordsPerPage;
+					const uint8_t* previous = m_values.data() + m_pages[index].firstValue * sizeof(T);
 
-#if PATTERNS_USE_HINTS && PATTERNS_CAN_SERIALIZE_HINTS
-void basic_pattern_impl::hint(uint64_t hash, uintptr_t address)
-{
-	auto& hints = getHints();
+					const size_t at = bits.size();
+					bits.resize(at + m_wordsPerPage);
+					size_t kept = 0;
+					for (size_t word = 0; word < m_wordsPerPage; word++)
+					{
+						uint64_t out = 0;
+						for (uint64_t set = oldBits[word]; set != 0; set &= set - 1, previous += sizeof(T))
+						{
+							const size_t bit = __builtin_ctzll(set);
+							const uint8_t* current = page + (word * 64 + bit) * m_align;
+							T value, last;
+							memcpy(&value, current, sizeof(T));
+							memcpy(&last, previous, sizeof(T));
+							if (test(value, last))
+							{
+								out |= uint64_t(1) << bit;
+								values.insert(values.end(), current, current + sizeof(T));
+								kept++;
+							}
+						}
+						bits[at + word] = out;
+					}
 
-	auto range = hints.equal_range(hash);
+					if (kept == 0)
+					{
+						bits.resize(at);
+						continue;
+					}
+					pages.push_back({ m_pages[index].address, count });
+					count += kept;
+				}
 
-	for (auto it = range.first; it != range.second; ++it)
+				// a page which is gone takes its candidates with it, the rest of the run is read again behind it
+				run = (readEnd < runEnd) ? readEnd + 1 : runEnd;
+			}
+		});
+	});
+
+	if (!tested)
 	{
-		if (it->second == address)
-		{
-			return;
-		}
+		return m_count;
 	}
 
-	hints.emplace(hash, address);
+	m_pages = std::move(pages);
+	m_bits = std::move(bits);
+	m_values = std::move(values);
+	m_count = count;
+	PATTERNS_LOGIS("value_scan: next scan, candidates: %zu, pages: %zu", m_count, m_pages.size());
+	return m_count;
 }
-#endif
 
 }
-}
\ No newline at end of file
+}